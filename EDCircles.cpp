@@ -5,22 +5,25 @@
 #include <iostream>
 #include <vector>
 #include <algorithm>
+#include <numeric>
 #include <cmath>
-#include <stdlib.h>
-
-#define MAGNITUDE "magnitude"
-#define DIRECTION "direction"
+#include <cassert>
+#include "common/Image.hpp"
+#include "common/Derivatives.hpp"
+#include "common/Gaussian.hpp"
+#include "common/GradientStatistics.hpp"
+#include "common/MatView.hpp"
+#include "common/PackedDirections.hpp"
+#include "common/PixelFormats.hpp"
+#include "common/ThreadPool.hpp"
+#include "common/StageTiming.hpp"
+#include "common/VideoPipeline.hpp"
+#include "common/FrameSinks.hpp"
+#include "common/Benchmark.hpp"
 
 using namespace cv;
 using namespace std;
 
-struct BGR
-{
-    float B;
-    float G;
-    float R;
-};//struct BGR
-
 struct Anchor
 {
     float value;
@@ -28,951 +31,2419 @@ struct Anchor
     int   j;
 };//struct Anchor
 
-typedef Anchor* AnchorArray;
-
-typedef struct Edge_Struct
+//The edges of a frame. The pixels of all of the edges are kept in one
+//array, edge after edge, and offsets holds where each edge starts (a
+//compressed sparse row layout), so an edge is a contiguous run of pixels and
+//adding one costs no allocation of its own.
+//clear() only resets the sizes. An edge list that is kept from frame to
+//frame works as an arena: once its arrays have grown to the size of a busy
+//frame, building the edges of a frame does not allocate at all.
+class EdgeList
 {
-    int         length;
-    AnchorArray anchors;
-} Edge;
+public:
+    EdgeList() : offsets(1, 0) {}
 
-typedef Edge*       EdgeHandle;
-typedef EdgeHandle* DynamicEdge;
+    //removes every edge, in constant time
+    void clear()
+    {
+        pixels .clear();
+        offsets.resize(1);
+    }//clear
 
-typedef struct EdgeList_Struct
-{
-    int         length;
-    DynamicEdge edges;
-} EdgeList;
+    int edgeCount() const
+    {
+        return int(offsets.size()) - 1;
+    }//edgeCount
 
-typedef EdgeList*       EdgeListHandle;
-typedef EdgeListHandle* DynamicEdgeList;
+    int pixelCount() const
+    {
+        return int(pixels.size());
+    }//pixelCount
 
-void grayScale(vector< vector<BGR> >& input)
-{
-    const float NORMALIZE_GRAYSCALE = 1.0/3.0;
+    int length(int edge) const
+    {
+        return offsets[edge + 1] - offsets[edge];
+    }//length
 
-    int rows = input.size();
-    int cols = input[0].size();
+    //the pixels of an edge, in the order they were linked
+    const Anchor* edge(int edge) const
+    {
+        return pixels.data() + offsets[edge];
+    }//edge
 
-    for (int i = 0; i < rows; i++)
+    //the edge being built is made of the pixels added since the last
+    //closeEdge() or discardEdge()
+    void addPixel(const Anchor& pixel)
     {
-        for (int j = 0; j < cols; j++)
-        {
-            input[i][j].B = NORMALIZE_GRAYSCALE*(input[i][j].R +
-                                                 input[i][j].G +
-                                                 input[i][j].B);
-            input[i][j].G = input[i][j].B;
-            input[i][j].R = input[i][j].B;
-        }//for
-    }//for
-}//grayScale
+        pixels.push_back(pixel);
+    }//addPixel
 
-//smoothing filter using two masks
-//this filter ensures that we get 'nice' derivatives later
-vector< vector<BGR> > gaussianFilter(vector< vector<BGR> >& input)
-{
-    //Gaussian filter normalized terms
-    const float GAUSS_TERM1 = 0.006;
-    const float GAUSS_TERM2 = 0.061;
-    const float GAUSS_TERM3 = 0.242;
-    const float GAUSS_TERM4 = 0.383;
+    int openLength() const
+    {
+        return int(pixels.size()) - offsets.back();
+    }//openLength
 
-    int rows = input.size();
-    int cols = input[0].size();
+    //ends the edge being built. An edge without pixels is dropped.
+    void closeEdge()
+    {
+        if (openLength() > 0)
+        {
+            offsets.push_back(int(pixels.size()));
+        }//if
+    }//closeEdge
 
-    vector< vector<BGR> > output = input;
+    //reverses the order of the pixels added to the edge being built, so an
+    //edge can be grown in both directions from its first pixel
+    void reverseOpenEdge()
+    {
+        reverse(pixels.begin() + offsets.back(), pixels.end());
+    }//reverseOpenEdge
 
-    //horizontal mask, the values are obtained from
-    //a gaussian mask after normalization
-    for (int i = 0; i < rows; i++)
+    //drops the pixels of the edge being built
+    void discardEdge()
     {
-        for (int j = 3; j < cols - 3; j++)
-        {
-            output[i][j].B = GAUSS_TERM1*input[i][j - 3].B
-                            +GAUSS_TERM2*input[i][j - 2].B
-                            +GAUSS_TERM3*input[i][j - 1].B
-                            +GAUSS_TERM4*input[i][  j  ].B
-                            +GAUSS_TERM3*input[i][j + 1].B
-                            +GAUSS_TERM2*input[i][j + 2].B
-                            +GAUSS_TERM1*input[i][j + 3].B;
-        }//for
-    }//for
+        pixels.resize(offsets.back());
+    }//discardEdge
+
+private:
+    vector<Anchor> pixels;
+    vector<int>    offsets; //edgeCount() + 1 entries, the last one is pixels.size()
+};//class EdgeList
+
+//*****************************************************************************
+//stages
+//
+//each stage is written as a kernel that computes one row of its output from
+//rows of its input. The whole-frame stages below run the kernels over the
+//frame, and AnchorPipeline runs the same kernels fused, band by band, so
+//both give the same result.
+//*****************************************************************************
+
+//Gaussian filter normalized terms
+const float GAUSS_TERM1 = 0.006;
+const float GAUSS_TERM2 = 0.061;
+const float GAUSS_TERM3 = 0.242;
+const float GAUSS_TERM4 = 0.383;
+
+//quantization error elimination threshold
+//for the Prewitt Operator
+const float QUANT_ERROR_ELIM_THRESH = 8.48;
+
+//edge directions, as stored in the direction map. An anchor has to be at
+//least as strong as its two neighbors along the edge.
+const unsigned HORIZONTAL_EDGE    = 0; //left and right neighbors
+const unsigned VERTICAL_EDGE      = 1; //neighbors above and below
+const unsigned DIAGONAL_DOWN_EDGE = 2; //(i - 1, j - 1) and (i + 1, j + 1)
+const unsigned DIAGONAL_UP_EDGE   = 3; //(i - 1, j + 1) and (i + 1, j - 1)
+
+//bits per pixel of the direction map. 1 only tells horizontal and vertical
+//edges apart, 2 also gives the diagonals.
+const int EDGE_DIRECTION_BITS = 1;
+
+typedef PackedDirections<EDGE_DIRECTION_BITS> DirectionMap;
+
+template <typename In, typename Out>
+void grayScaleRow(const In* in, Out* out, int cols)
+{
+    const float NORMALIZE_GRAYSCALE = 1.0/3.0;
 
-    //vertical gaussian mask, same as above
-    for (int i = 3; i < rows - 3; i++)
+    for (int j = 0; j < cols; j++)
     {
-        for (int j = 0; j < cols; j++)
-        {
-            output[i][j].B = GAUSS_TERM1*input[i - 3][j].B
-                            +GAUSS_TERM2*input[i - 2][j].B
-                            +GAUSS_TERM3*input[i - 1][j].B
-                            +GAUSS_TERM4*input[  i  ][j].B
-                            +GAUSS_TERM3*input[i + 1][j].B
-                            +GAUSS_TERM2*input[i + 2][j].B
-                            +GAUSS_TERM1*input[i + 3][j].B;
-        }//for
+        out[j] = saturateCast<Out>(NORMALIZE_GRAYSCALE*(float(in[j].R) +
+                                                        float(in[j].G) +
+                                                        float(in[j].B)));
     }//for
+}//grayScaleRow
 
-    return output;
-}//gaussianFilter
+//the mask [TERM1, TERM2, TERM3, TERM4, TERM3, TERM2, TERM1]
+inline const GaussianWeights& gaussWeights()
+{
+    static const GaussianWeights weights = gaussianWeights(GAUSS_TERM4, GAUSS_TERM3, GAUSS_TERM2, GAUSS_TERM1);
+
+    return weights;
+}//gaussWeights
 
-//applies the prewitt derivative
-vector< vector<BGR> > prewittOp(vector< vector<BGR> >& input, string control)
+//the gradient magnitude of a pixel. The derivatives of a Gray8 image are
+//exact, and their magnitude is at most 6*255.
+inline Gray16 prewittMagnitude(int g_x, int g_y)
 {
-    //quantization error elimination threshold
-    //for the Prewitt Operator
-    const float QUANT_ERROR_ELIM_THRESH = 8.48;
+    int magnitude = abs(g_x) + abs(g_y);
 
-    //angles
-    const float VERTICAL   = 90;
-    const float HORIZONTAL = 0;
+    if (magnitude < QUANT_ERROR_ELIM_THRESH)
+    {
+        return 0;
+    }//if
 
-    int rows = input.size();
-    int cols = input[0].size();
+    return Gray16(magnitude);
+}//prewittMagnitude
 
-    vector< vector<BGR> > output(rows, vector<BGR>(cols));
-    vector< vector<BGR> > temp_x(rows, vector<BGR>(cols));
-    vector< vector<BGR> > temp_y(rows, vector<BGR>(cols));
-    vector< vector<BGR> > Gx    (rows, vector<BGR>(cols));
-    vector< vector<BGR> > Gy    (rows, vector<BGR>(cols));
+inline Gray16 prewittMagnitude(float g_x, float g_y)
+{
+    float magnitude = abs(g_x) + abs(g_y);
 
-    //we apply the horizontal masks, [-1, 0, 1] (derivative mask for x) and
-    //[1, 1, 1] (averaging mask for y)
-    for (int i = 0; i < rows; i++)
+    if (magnitude < QUANT_ERROR_ELIM_THRESH)
     {
-        for (int j = 1; j < cols - 1; j++)
-        {
-            temp_x[i][j].B = -1*input[i][j - 1].B +
-                                input[i][j + 1].B;
+        return 0;
+    }//if
 
-            temp_y[i][j].B = input[i][j - 1].B +
-                             input[i][  j  ].B +
-                             input[i][j + 1].B;
-        }//for
-    }//for
+    return saturateCast<Gray16>(magnitude);
+}//prewittMagnitude
 
-    //we now take the previous results and apply the vertical masks,
-    //[1; 1; 1] (averaging mask for x) and
-    //[-1; 0; 1] (derivative mask for y)
-    //this results in the x and y gradients, Gx and Gy
-    for (int i = 1; i < rows - 1; i++)
+//the direction code of the edge through a pixel
+template <int BITS, typename Gradient>
+inline unsigned edgeDirection(Gradient g_x, Gradient g_y)
+{
+    //if the gradient is stronger along the x direction,
+    //then we have a vertical edge
+    //similarly for the y direction, we have a horizontal edge
+    if (BITS == 1)
     {
-        for (int j = 0; j < cols; j++)
-        {
-            Gx[i][j].B = temp_x[i - 1][j].B +
-                         temp_x[  i  ][j].B +
-                         temp_x[i + 1][j].B;
+        return g_x >= g_y ? VERTICAL_EDGE : HORIZONTAL_EDGE;
+    }//if
 
-            Gy[i][j].B = -1*temp_y[i - 1][j].B + temp_y[i + 1][j].B;
-        }//for
-    }//for
+    //with two bits the gradient is rounded to the nearest multiple of 45
+    //degrees, and the edge runs across it
+    const float TAN_22_5 = 0.41421356f;
 
-    //calculate the gradient magnitude
-    if (control == MAGNITUDE)
+    float a_x = abs(float(g_x));
+    float a_y = abs(float(g_y));
+
+    if (a_y <= TAN_22_5*a_x)
     {
-        for (int i = 0; i < rows; i++)
-        {
-            for (int j = 0; j < cols; j++)
-            {
-                output[i][j].B = abs(Gx[i][j].B) + abs(Gy[i][j].B);
+        return VERTICAL_EDGE;
+    }//if
 
-                if (output[i][j].B < QUANT_ERROR_ELIM_THRESH)
-                {
-                    output[i][j].B = 0;
-                }//if
-            }//for
-        }//for
+    if (a_x <= TAN_22_5*a_y)
+    {
+        return HORIZONTAL_EDGE;
     }//if
 
-    //calculate the gradient direction in degrees
-    //only vertical and horizontal angles are distinguished
-    else if (control == DIRECTION)
+    //a gradient pointing down and to the right, or up and to the left, is
+    //crossed by an edge from the bottom left to the top right
+    if ((g_x > 0) == (g_y > 0))
     {
-        for (int i = 0; i < rows; i++)
+        return DIAGONAL_UP_EDGE;
+    }//if
+
+    return DIAGONAL_DOWN_EDGE;
+}//edgeDirection
+
+//the gradient magnitude and the packed edge direction of one row of
+//derivatives, in one pass
+template <int BITS, typename Gradient>
+void prewittRow(const Gradient* g_x, const Gradient* g_y, Gray16* magnitude, uint8_t* direction, int cols)
+{
+    const int PIXELS_PER_BYTE = PackedDirections<BITS>::PIXELS_PER_BYTE;
+
+    for (int first = 0; first < cols; first += PIXELS_PER_BYTE)
+    {
+        int      last   = min(first + PIXELS_PER_BYTE, cols);
+        unsigned packed = 0;
+
+        for (int j = first; j < last; j++)
         {
-            for (int j = 0; j < cols; j++)
-            {
-                //if the gradient is stronger along the x direction,
-                //then we have a vertical edge
-                //similarly for the y direction, we have a horizontal edge
-                //(angles are measured from the horizontal)
-                if (Gx[i][j].B >= Gy[i][j].B)
-                {
-                    output[i][j].B = VERTICAL;
-                }//if
-                else
-                {
-                    output[i][j].B = HORIZONTAL;
-                }//else
-            }//for
+            magnitude[j] = prewittMagnitude(g_x[j], g_y[j]);
+
+            packed |= edgeDirection<BITS>(g_x[j], g_y[j]) << ((j - first)*BITS);
         }//for
-    }//else if
 
-    return output;
-}//prewittOp
+        direction[first/PIXELS_PER_BYTE] = uint8_t(packed);
+    }//for
+}//prewittRow
 
-void suppressPixel(vector< vector<Anchor> >& output, int i, int j)
+void suppressPixel(Anchor& anchor, int i, int j)
 {
-    output[i][j].value    = 0;
-    output[i][j].i        = i;
-    output[i][j].j        = j;
+    anchor.value    = 0;
+    anchor.i        = i;
+    anchor.j        = j;
 }//suppressPixel
 
-void keepPixel(vector< vector<Anchor> >& output, int i, int j, float value)
+void keepPixel(Anchor& anchor, int i, int j, float value)
 {
-    output[i][j].value    = value;
-    output[i][j].i        = i;
-    output[i][j].j        = j;
+    anchor.value    = value;
+    anchor.i        = i;
+    anchor.j        = j;
 }//keepPixel
 
-vector< vector<Anchor> > getAnchorMap(vector< vector<BGR> >& input,
-                                      vector< vector<BGR> >& magnitudeMap,
-                                      vector< vector<BGR> >& directionMap)
+//the border pixels are never anchors
+void suppressRow(Anchor* out, int i, int cols)
 {
-    //angles
-    const float VERTICAL   = 90;
-    const float HORIZONTAL = 0;
-
-    int rows = input.size();
-    int cols = input[0].size();
-
-    vector< vector<Anchor> > output(rows, vector<Anchor>(cols));
-
-    for (int i = 1; i < rows - 1; i++)
+    for (int j = 0; j < cols; j++)
     {
-        for (int j = 1; j < cols - 1; j++)
-        {
-            //we use non-maximum suppression to extract the anchors.
-            //this means that we only take those maxima which are 'peaks'
-            //in the intensity map. Taking ordianry maxima is not enough due
-            //to the existence of saddle-points.
-            if (directionMap[i][j].B == VERTICAL)
-            {
-                // in this case, we have a vertical edge,
-                // so we need to make sure that
-                // the point in question is the highest in the vertical
-                // direction. So if it
-                // is less than either the neighbor above or below it,
-                // it is suppressed, and if not it is kept.
-                if (magnitudeMap[i][j].B < magnitudeMap[i + 1][j].B ||
-                    magnitudeMap[i][j].B < magnitudeMap[i - 1][j].B)
-                {
-                    suppressPixel(output, i, j);
-                }//if
-                else
-                {
-                    keepPixel(output, i, j, magnitudeMap[i][j].B);
-                }//else
-            }//if
-
-            //this is the same as above except for horizontal edges, which are
-            //compared to their left and right-hand neighbors.
-            if (directionMap[i][j].B == HORIZONTAL)
-            {
-                if (magnitudeMap[i][j].B < magnitudeMap[i][j + 1].B ||
-                    magnitudeMap[i][j].B < magnitudeMap[i][j - 1].B)
-                {
-                    suppressPixel(output, i, j);
-                }//if
-                else
-                {
-                    keepPixel(output, i, j, magnitudeMap[i][j].B);
-                }//else
-            }//if
-        }//for
+        suppressPixel(out[j], i, j);
     }//for
+}//suppressRow
 
-    return output;
-}//extractAnchors
-
-vector< vector<BGR> > convertAnchorToBGR(vector< vector<Anchor> >& anchorMap)
+//the anchors of row i, from the magnitude of rows i - 1 .. i + 1 and the
+//direction of row i
+template <int BITS>
+void anchorRow(const Gray16* magAbove, const Gray16* mag, const Gray16* magBelow,
+               const uint8_t* dir, Anchor* out, int i, int cols)
 {
-    int rows = anchorMap.size();
-    int cols = anchorMap[0].size();
+    suppressPixel(out[0],        i, 0       );
+    suppressPixel(out[cols - 1], i, cols - 1);
 
-    vector< vector<BGR> > output(rows, vector<BGR>(cols));
-
-    for (int i = 0; i < rows; i++)
+    for (int j = 1; j < cols - 1; j++)
     {
-        for (int j = 0; j < cols; j++)
+        //we use non-maximum suppression to extract the anchors.
+        //this means that we only take those maxima which are 'peaks'
+        //in the intensity map. Taking ordianry maxima is not enough due
+        //to the existence of saddle-points.
+        //a pixel on a vertical edge has to be the highest in the vertical
+        //direction, so it is compared to the neighbors above and below
+        //it, a pixel on a horizontal edge to its left and right-hand
+        //neighbors, and a pixel on a diagonal edge to the neighbors on
+        //that diagonal. If it is less than either of them, it is
+        //suppressed, and if not it is kept.
+        Gray16 first;
+        Gray16 second;
+
+        switch (PackedDirections<BITS>::get(dir, j))
         {
-            output[i][j].B = anchorMap[i][j].value;
-        }//for
+            case VERTICAL_EDGE:
+                first  = magAbove[j];
+                second = magBelow[j];
+                break;
+
+            case HORIZONTAL_EDGE:
+                first  = mag[j - 1];
+                second = mag[j + 1];
+                break;
+
+            case DIAGONAL_DOWN_EDGE:
+                first  = magAbove[j - 1];
+                second = magBelow[j + 1];
+                break;
+
+            default: //DIAGONAL_UP_EDGE
+                first  = magAbove[j + 1];
+                second = magBelow[j - 1];
+                break;
+        }//switch
+
+        if (mag[j] < first || mag[j] < second)
+        {
+            suppressPixel(out[j], i, j);
+        }//if
+        else
+        {
+            keepPixel(out[j], i, j, mag[j]);
+        }//else
     }//for
+}//anchorRow
 
-    return output;
-}//convertAnchorToBGR
-
-//M is simply the number of non-zero valued pixels in the
-//magnitude map
-float getM(vector< vector<BGR> >& magnitudeMap)
+//anchors that were kept with a value of 0 do not go into the anchor list
+int countAnchors(const Anchor* anchors, int cols)
 {
-    int rows = magnitudeMap.size();
-    int cols = magnitudeMap[0].size();
+    int count = 0;
 
-    int M = 0;
-
-    for (int i = 0; i < rows; i++)
+    for (int j = 0; j < cols; j++)
     {
-        for (int j = 0; j < cols; j++)
-        {
-            if (magnitudeMap[i][j].B != 0)
-            {
-                ++M;
-            }//if
-        }//for
+        count += anchors[j].value != 0;
     }//for
 
-    return float(M);
-}//getM
+    return count;
+}//countAnchors
 
-//The empircal cumulative distribution is a function H(mu), where mu
-//is the minimum value of a pixel on an edge, and the value H is given by
-//the number of pixels in the magnitude map with values greater than or equal
-//to mu. The function is represented here as a vector. This reduces an O(n)
-//operation to O(1).
-vector<float> getEmpCumDist(vector< vector<BGR> >& magnitudeMap)
+//copies the anchors of a row that go into the anchor list to out, in order
+void compactAnchors(const Anchor* anchors, int cols, Anchor* out)
 {
-    const int NUM_PIXEL_VALUES = 256;
-
-    vector<float> output(NUM_PIXEL_VALUES);
-
-    int rows = magnitudeMap.size();
-    int cols = magnitudeMap[0].size();
-
-    float M = getM(magnitudeMap);
-
-    output[0] = rows*cols;
-
-    for (int k = 1; k < NUM_PIXEL_VALUES; k++)
+    for (int j = 0; j < cols; j++)
     {
-        output[k] = 0;
-
-        for (int i = 0; i < rows; i++)
+        if (anchors[j].value != 0)
         {
-            for (int j = 0; j < cols; j++)
-            {
-                if (magnitudeMap[i][j].B >= k)
-                {
-                    output[k] = output[k] + 1;
-                }//if
-            }//for
-        }//for
-
-        output[k] = output[k]/M;
+            *out = anchors[j];
+            out++;
+        }//if
     }//for
+}//compactAnchors
 
-    return output;
-}//getEmpCumDist
-
-//Takes all non-zero pixels in the anchor map and puts them in a list
-//to be sorted and accessed in order.
-vector<Anchor> getAnchorList(vector< vector<Anchor> >& anchorMap)
+//the same without a branch per pixel, every anchor is written and the next
+//one overwrites it if it is not kept. out needs room for cols anchors.
+//returns the number of anchors kept.
+int compactAnchorsUnbounded(const Anchor* anchors, int cols, Anchor* out)
 {
-    int rows     = anchorMap.size();
-    int cols     = anchorMap[0].size();
-    int listSize = 0;
-
-    vector<Anchor> anchorList(listSize);
+    int count = 0;
 
-    for (int i = 0; i < rows; i++)
+    for (int j = 0; j < cols; j++)
     {
-        for (int j = 0; j < cols; j++)
-        {
-            if (anchorMap[i][j].value != 0)
-            {
-                ++listSize;
-
-                anchorList.resize(listSize);
-
-                anchorList[listSize - 1] = anchorMap[i][j];
-            }//if
-        }//for
+        out[count] = anchors[j];
+        count     += anchors[j].value != 0;
     }//for
 
-    return anchorList;
-}//getAnchorList
+    return count;
+}//compactAnchorsUnbounded
 
-//Quicksort partition function. Needed for sortAnchorList(...)
-int partitionList(vector<Anchor>& anchorList, int l, int r)
+template <typename In, typename Out>
+void grayScale(const ImageView<In>& input, Image<Out>& output)
 {
-    Anchor pivot;
-    Anchor temp;
+    STAGE_TIMER("conversion");
 
-    pivot = anchorList[l];
+    int rows = input.rows;
+    int cols = input.cols;
 
-    int i = l; int j = r + 1;
+    output.create(rows, cols);
 
-    while (1)
+    parallelForRows(0, rows, 0, [&](int begin, int end)
     {
-        do ++i; while (anchorList[i].value <= pivot.value && i <= r);
-        do --j; while (anchorList[j].value >  pivot.value);
-
-        if (i >= j)
+        for (int i = begin; i < end; i++)
         {
-            break;
-        }//if
+            grayScaleRow(input.row(i), output.row(i), cols);
+        }//for
+    });
+}//grayScale
 
-        temp          = anchorList[i];
-        anchorList[i] = anchorList[j];
-        anchorList[j] = temp;
-    }//while
+//smoothing filter using two masks
+//this filter ensures that we get 'nice' derivatives later
+//Gray8 images are smoothed in fixed point, Gray32f images in floating point
+//the rings of horizontally smoothed rows are kept by the caller
+template <typename T>
+void gaussianFilter(const ImageView<T>& input, Image<T>& output, GaussianRings<T>& rings)
+{
+    STAGE_TIMER("gaussian");
 
-    temp          = anchorList[i];
-    anchorList[i] = anchorList[j];
-    anchorList[j] = temp;
+    output.create(input.rows, input.cols);
 
-    return j;
-}//partionList
+    gaussianSmooth(ImageView<const T>(input), ImageView<T>(output), gaussWeights(), rings);
+}//gaussianFilter
 
-//Sorts the anchors in the anchor list using quicksort
-vector<Anchor> sortAnchorList(vector<Anchor>& anchorList, int l, int r)
+//the two gradient line buffers of every thread of the pool, x then y. The
+//caller keeps them from frame to frame, so they are only allocated once.
+template <typename Gray>
+class GradientRows
 {
-    int j;
+public:
+    typedef typename DerivativeTraits<Gray>::Gradient Gradient;
 
-    if (l < r)
+    GradientRows() : buffers(threadPool().size()) {}
+
+    //the rows of the calling thread, for cols pixels
+    Image<Gradient>& threadRows(int cols)
     {
-        j = partitionList(anchorList, l, r);
+        Image<Gradient>& rows = buffers[ThreadPool::threadIndex()];
 
-        sortAnchorList(anchorList, l,     j - 1);
-        sortAnchorList(anchorList, j + 1, r    );
-    }//if
+        rows.create(2, cols);
 
-    return anchorList;
-}//sortAnchorList
+        return rows;
+    }//threadRows
 
-//*****************************************************************************
-//The following functions are for manipulating edge lists.
-//*****************************************************************************
+private:
+    vector<Image<Gradient> > buffers;
+};//class GradientRows
 
-EdgeHandle initEdge(int length)
+//applies the prewitt derivative, and computes the gradient magnitude and
+//the edge direction from the same derivatives. The derivatives only live in
+//the two line buffers of the thread that runs each band.
+//the derivatives are exact Gray16s for a Gray8 input and Gray32f for a
+//Gray32f input, the magnitude is rounded to Gray16 either way
+template <typename In, int BITS>
+void prewittOp(const ImageView<In>& input, Image<Gray16>& magnitudeMap, PackedDirections<BITS>& directionMap,
+               GradientRows<typename std::remove_const<In>::type>& gradientRows)
 {
-    EdgeHandle edge = (EdgeHandle) malloc(sizeof(Edge));
+    STAGE_TIMER("gradient");
 
-    edge -> length  = length;
-    edge -> anchors = (AnchorArray) calloc(length, sizeof(Anchor));
+    typedef typename std::remove_const<In>::type       Gray;
+    typedef typename DerivativeTraits<Gray>::Gradient  Gradient;
 
-    return edge;
-}//initEdge
+    int rows = input.rows;
+    int cols = input.cols;
 
-void copyEdge(EdgeHandle from, EdgeHandle to)
-{
-    int i;
-    for (i = 0; i < from -> length; i++)
+    magnitudeMap.create(rows, cols);
+    directionMap.create(rows, cols);
+
+    parallelForRows(0, rows, 1, [&](int begin, int end)
     {
-        to -> anchors[i] = from -> anchors[i];
-    }//for
-}//copyEdge
+        Image<Gradient>& gradients = gradientRows.threadRows(cols);
 
-void deleteEdge(DynamicEdge edge)
-{
-    free((*edge) -> anchors);
-    free(*edge);
+        Gradient* g_x = gradients.row(0);
+        Gradient* g_y = gradients.row(1);
+
+        for (int i = begin; i < end; i++)
+        {
+            //the x gradient is the derivative mask [-1, 0, 1] applied
+            //horizontally and the averaging mask [1; 1; 1] vertically, the y
+            //gradient is the same with the directions swapped. They are 0 on
+            //the first and last rows.
+            if (i == 0 || i == rows - 1)
+            {
+                gradients.fill(0);
+            }//if
+            else
+            {
+                derivativeRow((const Gray*) input.row(i - 1), (const Gray*) input.row(i), (const Gray*) input.row(i + 1),
+                              g_x, g_y, cols, PREWITT_KERNEL);
+            }//else
 
-    *edge = NULL;
-}//deleteEdge
+            prewittRow<BITS>((const Gradient*) g_x, (const Gradient*) g_y, magnitudeMap.row(i), directionMap.row(i), cols);
+        }//for
+    });
+}//prewittOp
 
-void growEdge(DynamicEdge edge)
+template <typename In, int BITS>
+void getAnchorMap(const ImageView<In>&           input,
+                  const ImageView<const Gray16>& magnitudeMap,
+                  const PackedDirections<BITS>&  directionMap,
+                  Image<Anchor>&                 output)
 {
-    EdgeHandle temp = initEdge(((*edge) -> length)*2 + 1);
+    STAGE_TIMER("anchors");
 
-    copyEdge(*edge, temp);
+    int rows = input.rows;
+    int cols = input.cols;
 
-    deleteEdge(edge);
+    output.create(rows, cols);
 
-    *edge = temp;
-}//growEdge
+    suppressRow(output.row(0),        0,        cols);
+    suppressRow(output.row(rows - 1), rows - 1, cols);
 
-void insertAnchor(DynamicEdge edge, int pixelNum, Anchor newAnchor)
-{
-    while (pixelNum + 1 >= (*edge) -> length)
+    parallelForRows(1, rows - 1, 1, [&](int begin, int end)
     {
-        growEdge(edge);
-    }//while
+        for (int i = begin; i < end; i++)
+        {
+            anchorRow<BITS>(magnitudeMap.row(i - 1), magnitudeMap.row(i), magnitudeMap.row(i + 1),
+                            directionMap.row(i), output.row(i), i, cols);
+        }//for
+    });
+}//extractAnchors
 
-    (*edge) -> anchors[pixelNum] = newAnchor;
-}//insertAnchor
+//*****************************************************************************
+//fused pipeline
+//*****************************************************************************
 
-EdgeListHandle initEdgeList(int length, int edgeLength)
+//runs grayScale, gaussianFilter, prewittOp (both modes) and getAnchorMap in a
+//single pass over the frame.
+//the frame is split into bands of rows that run on the thread pool, and each
+//band streams its rows through all four stages, keeping only the rows a stage
+//still needs in line buffers: the horizontally smoothed rows under the
+//vertical gaussian mask, the smoothed rows under the prewitt mask, and the
+//magnitude rows around an anchor row. For a 1080p frame that is at most 60KB
+//per thread, which stays in the L2 cache, so the intermediate images never
+//go out to memory. Only the magnitude, direction and anchor maps, which edge
+//linking reads, are written, at two bytes and BITS bits per pixel and one
+//anchor.
+//a band recomputes the few rows above and below it that its first and last
+//rows depend on.
+//with STAGE_TIMING, the time of each of the four stages is added up over the
+//rows of every band, and the sums are recorded per frame, as the CPU time
+//of the stage. That is four clock reads per row; the horizontal gaussian
+//pass of a row is counted with the vertical one, which it is followed by
+//once the band is under way.
+//Gray is the format of the gray and smoothed images: Gray8 smooths in fixed
+//point, Gray32f in floating point. BITS is the size of a direction code.
+template <typename Gray, int BITS = EDGE_DIRECTION_BITS>
+class AnchorPipeline
 {
-    EdgeListHandle edgeList = (EdgeListHandle) malloc(sizeof(EdgeList));
+public:
+    AnchorPipeline() : buffers(threadPool().size()) {}
+
+    //if histogram is not NULL, it receives the histogram of the magnitude
+    //map, counted as the rows are written. If anchorList is not NULL, it
+    //receives the same list as getAnchorList(anchorMap), taken from each
+    //anchor row right after it is computed.
+    void run(const ImageView<const BGR8>& frame,
+             Image<Gray16>&               magnitudeMap,
+             PackedDirections<BITS>&      directionMap,
+             Image<Anchor>&               anchorMap,
+             MagnitudeHistogram*          histogram  = NULL,
+             vector<Anchor>*              anchorList = NULL)
+    {
+        STAGE_TIMER("pipeline");
 
-    edgeList -> length = length;
-    edgeList -> edges  = (DynamicEdge) malloc(sizeof(EdgeHandle)*length);
+        int rows = frame.rows;
+        int cols = frame.cols;
 
-    int i;
-    for (i = 0; i < length; i++)
-    {
-        edgeList -> edges[i] = initEdge(edgeLength);
-    }//for
+        magnitudeMap.create(rows, cols);
+        directionMap.create(rows, cols);
+        anchorMap   .create(rows, cols);
 
-    return edgeList;
-}//initEdgeList
+        //gaussian, prewitt and anchor masks, one above the other
+        const int HALO = GAUSSIAN_RADIUS + 2;
 
-void copyEdgeList(EdgeListHandle from, EdgeListHandle to)
-{
-    int i;
-    int j;
-    for (i = 0; i < from -> length; i++)
-    {
-        for (j = 0; j < from -> edges[i] -> length; j++)
+        for (size_t k = 0; k < buffers.size(); k++)
         {
-            insertAnchor(&(to -> edges[i]), j, from -> edges[i] -> anchors[j]);
+            buffers[k].histogram.clear();
+            buffers[k].laps     .clear();
+            buffers[k].anchorCount = 0;
         }//for
-    }//for
-}//copyEdgeList
 
-void deleteEdgeList(DynamicEdgeList edgeList)
-{
-    int i;
-    for (i = 0; i < (*edgeList) -> length; i++)
-    {
-        deleteEdge(&((*edgeList) -> edges[i]));
-    }//for
+        rowAnchors.assign(rows, RowAnchors());
+
+        parallelForRows(0, rows, HALO, [&](int begin, int end)
+        {
+            runRows(frame, begin, end, magnitudeMap, directionMap, anchorMap,
+                    histogram != NULL, anchorList != NULL);
+        });
 
-    free(*edgeList);
+        if (histogram != NULL)
+        {
+            histogram -> clear();
+
+            for (size_t k = 0; k < buffers.size(); k++)
+            {
+                histogram -> merge(buffers[k].histogram);
+            }//for
+        }//if
 
-    *edgeList = NULL;
-}//deleteEdgeList
+        if (anchorList != NULL)
+        {
+            gatherAnchors(*anchorList);
+        }//if
 
-void growEdgeList(DynamicEdgeList edgeList)
-{
-    EdgeListHandle temp = initEdgeList(((*edgeList) -> length)*2 + 1, 0);
+        StageLaps<STAGES> laps;
 
-    copyEdgeList(*edgeList, temp);
+        for (size_t k = 0; k < buffers.size(); k++)
+        {
+            laps.add(buffers[k].laps);
+        }//for
 
-    deleteEdgeList(edgeList);
+        STAGE_RECORD("conversion", laps.nanoseconds(CONVERSION));
+        STAGE_RECORD("gaussian",   laps.nanoseconds(GAUSSIAN));
+        STAGE_RECORD("gradient",   laps.nanoseconds(GRADIENT));
+        STAGE_RECORD("anchors",    laps.nanoseconds(ANCHORS));
+    }//run
 
-    *edgeList = temp;
-}//growEdgeList
+private:
+    typedef typename GaussianTraits<Gray>::Horizontal   Horizontal;
+    typedef typename DerivativeTraits<Gray>::Gradient   Gradient;
 
-void insertAnchorToList(DynamicEdgeList edgeList, int edgeNum, int pixelNum, Anchor newAnchor)
-{
-    while (edgeNum + 1 >= (*edgeList) -> length)
+    static const int SMOOTHED_ROWS  = 3; //under the prewitt mask
+    static const int MAGNITUDE_ROWS = 3; //around an anchor row
+
+    //the stages the time of a band is split between
+    enum Stage
     {
-        growEdgeList(edgeList);
-    }//while
+        CONVERSION,
+        GAUSSIAN,
+        GRADIENT,
+        ANCHORS,
+        STAGES
+    };//enum Stage
+
+    //the line buffers of one thread, the rows of the gaussian, the smoothed
+    //and the magnitude rings are indexed by row % ring size. The directions
+    //of the rows next to the band, which belong to another band, go to
+    //the direction buffer.
+    struct Buffers
+    {
+        Image<Gray>       gray;
+        Image<Horizontal> horizontal;
+        Image<Gray>       smoothed;
+        Image<Gradient>   gx;
+        Image<Gradient>   gy;
+        Image<Gray16>     magnitude;
+        Image<uint8_t>    direction;
+
+        MagnitudeHistogram histogram; //of the rows the thread wrote
+        vector<Anchor>     anchors;   //of the rows the thread wrote, row by row
+        int                anchorCount; //anchors in use, the vector only grows
+
+        StageLaps<STAGES> laps; //time of the rows the thread computed, per stage
+    };//struct Buffers
+
+    //where the anchors of a row are in the anchor buffer of the thread that
+    //computed it
+    struct RowAnchors
+    {
+        int thread;
+        int first;
+        int count;
+
+        RowAnchors() : thread(0), first(0), count(0) {}
+    };//struct RowAnchors
+
+    //the maps of the rows begin .. end - 1, on the calling thread
+    void runRows(const ImageView<const BGR8>& frame, int begin, int end,
+                 const ImageView<Gray16>&      magnitudeMap,
+                 const PackedDirections<BITS>& directionMap,
+                 const ImageView<Anchor>&      anchorMap,
+                 bool                          countHistogram,
+                 bool                          collectAnchors)
+    {
+        int rows = frame.rows;
+        int cols = frame.cols;
 
-    insertAnchor(&((*edgeList) -> edges[edgeNum]), pixelNum, newAnchor);
-}//insertAnchorToList
+        const GaussianWeights& weights = gaussWeights();
 
-//*****************************************************************************
-//end of edge list manipulating functions
-//*****************************************************************************
+        int      thread = ThreadPool::threadIndex();
+        Buffers& buffer = buffers[thread];
 
-//This function uses a smart pathing algorithm to store edge pixels into edges
-void getEdgePixels(DynamicEdgeList edgeList,
-                   Anchor          anchor,
-                   int             edgeNum,
-                   vector< vector<BGR> >& magnitudeMap,
-                   vector< vector<BGR> >& directionMap,
-                   vector< vector<Anchor> >& anchorMap)
-{
-    const int HORIZONTAL =  0;
-    const int VERTICAL   = 90;
-    const int ROWS       = magnitudeMap.size();
-    const int COLS       = magnitudeMap[0].size();
+        buffer.gray      .create(1,              cols);
+        buffer.horizontal.create(GAUSSIAN_TAPS,  cols);
+        buffer.smoothed  .create(SMOOTHED_ROWS,  cols);
+        buffer.gx        .create(1,              cols);
+        buffer.gy        .create(1,              cols);
+        buffer.magnitude .create(MAGNITUDE_ROWS, cols);
+        buffer.direction .create(1,              PackedDirections<BITS>::packedCols(cols));
 
-    const int UP    = 0;
-    const int DOWN  = 1;
-    const int LEFT  = 2;
-    const int RIGHT = 3;
+        Gray*     gray = buffer.gray.row(0);
+        Gradient* g_x  = buffer.gx.row(0);
+        Gradient* g_y  = buffer.gy.row(0);
 
-    int direction;
+        //the magnitude of the rows next to the band is needed for its anchors
+        int magnitudeBegin = max(begin - 1, 0);
+        int magnitudeEnd   = min(end   + 1, rows);
 
-    int currentPixel;
+        int nextHorizontal = max(magnitudeBegin - 1 - GAUSSIAN_RADIUS, 0);
+        int nextSmoothed   = max(magnitudeBegin - 1,                   0);
 
-    currentPixel = 0;
+        if (begin == 0)
+        {
+            suppressRow(anchorMap.row(0), 0, cols);
+        }//if
 
-    while(magnitudeMap[anchor.i][anchor.j].B != 0 && anchor.i < ROWS && anchor.j < COLS)
-    {
-        insertAnchorToList(edgeList, edgeNum, currentPixel, anchor);
+        buffer.laps.start();
 
-        if (anchorMap[anchor.i][anchor.j].value != 0) //if pixel is an anchor
+        for (int m = magnitudeBegin; m < magnitudeEnd; m++)
         {
-            if (directionMap[anchor.i][anchor.j].B == HORIZONTAL)
+            //the smoothed rows under the prewitt mask of row m, and the
+            //horizontally smoothed rows under their vertical gaussian masks
+            for (; nextSmoothed < min(m + 2, rows); nextSmoothed++)
             {
-                if (magnitudeMap[anchor.i - 1][anchor.j - 1].B >= magnitudeMap[anchor.i    ][anchor.j - 1].B &&
-                    magnitudeMap[anchor.i - 1][anchor.j - 1].B >= magnitudeMap[anchor.i + 1][anchor.j - 1].B &&
-                    magnitudeMap[anchor.i - 1][anchor.j - 1].B >= magnitudeMap[anchor.i - 1][anchor.j + 1].B &&
-                    magnitudeMap[anchor.i - 1][anchor.j - 1].B >= magnitudeMap[anchor.i    ][anchor.j + 1].B &&
-                    magnitudeMap[anchor.i - 1][anchor.j - 1].B >= magnitudeMap[anchor.i + 1][anchor.j + 1].B)
+                int  s          = nextSmoothed;
+                bool fullWindow = gaussianFullWindow(s, rows);
+
+                for (; nextHorizontal < (fullWindow ? s + GAUSSIAN_RADIUS + 1 : s + 1); nextHorizontal++)
                 {
-                    anchor.i     = anchor.i - 1;
-                    anchor.j     = anchor.j - 1;
-                    anchor.value = magnitudeMap[anchor.i][anchor.j].B;
+                    grayScaleRow(frame.row(nextHorizontal), gray, cols);
 
-                    ++currentPixel;
+                    buffer.laps.lap(CONVERSION);
 
-                    direction = LEFT;
-                }//if
-                else if (magnitudeMap[anchor.i    ][anchor.j - 1].B >= magnitudeMap[anchor.i - 1][anchor.j - 1].B &&
-                         magnitudeMap[anchor.i    ][anchor.j - 1].B >= magnitudeMap[anchor.i + 1][anchor.j - 1].B &&
-                         magnitudeMap[anchor.i    ][anchor.j - 1].B >= magnitudeMap[anchor.i - 1][anchor.j + 1].B &&
-                         magnitudeMap[anchor.i    ][anchor.j - 1].B >= magnitudeMap[anchor.i    ][anchor.j + 1].B &&
-                         magnitudeMap[anchor.i    ][anchor.j - 1].B >= magnitudeMap[anchor.i + 1][anchor.j + 1].B)
-                {
-                    anchor.j     = anchor.j - 1;
-                    anchor.value = magnitudeMap[anchor.i][anchor.j].B;
-
-                    ++currentPixel;
-
-                    direction = LEFT;
-                }//else if
-                else if (magnitudeMap[anchor.i + 1][anchor.j - 1].B >= magnitudeMap[anchor.i    ][anchor.j - 1].B &&
-                         magnitudeMap[anchor.i + 1][anchor.j - 1].B >= magnitudeMap[anchor.i - 1][anchor.j - 1].B &&
-                         magnitudeMap[anchor.i + 1][anchor.j - 1].B >= magnitudeMap[anchor.i - 1][anchor.j + 1].B &&
-                         magnitudeMap[anchor.i + 1][anchor.j - 1].B >= magnitudeMap[anchor.i    ][anchor.j + 1].B &&
-                         magnitudeMap[anchor.i + 1][anchor.j - 1].B >= magnitudeMap[anchor.i + 1][anchor.j + 1].B)
-                {
-                    anchor.i     = anchor.i + 1;
-                    anchor.j     = anchor.j - 1;
-                    anchor.value = magnitudeMap[anchor.i][anchor.j].B;
-
-                    ++currentPixel;
-
-                    direction = LEFT;
-                }//else if
-                else if (magnitudeMap[anchor.i - 1][anchor.j + 1].B >= magnitudeMap[anchor.i    ][anchor.j - 1].B &&
-                         magnitudeMap[anchor.i - 1][anchor.j + 1].B >= magnitudeMap[anchor.i - 1][anchor.j - 1].B &&
-                         magnitudeMap[anchor.i - 1][anchor.j + 1].B >= magnitudeMap[anchor.i + 1][anchor.j - 1].B &&
-                         magnitudeMap[anchor.i - 1][anchor.j + 1].B >= magnitudeMap[anchor.i    ][anchor.j + 1].B &&
-                         magnitudeMap[anchor.i - 1][anchor.j + 1].B >= magnitudeMap[anchor.i + 1][anchor.j + 1].B)
-                {
-                    anchor.i = anchor.i - 1;
-                    anchor.j = anchor.j + 1;
-                    anchor.value = magnitudeMap[anchor.i][anchor.j].B;
-
-                    ++currentPixel;
-
-                    direction = RIGHT;
-                }//else if
-                else if (magnitudeMap[anchor.i    ][anchor.j + 1].B >= magnitudeMap[anchor.i    ][anchor.j - 1].B &&
-                         magnitudeMap[anchor.i    ][anchor.j + 1].B >= magnitudeMap[anchor.i + 1][anchor.j - 1].B &&
-                         magnitudeMap[anchor.i    ][anchor.j + 1].B >= magnitudeMap[anchor.i - 1][anchor.j + 1].B &&
-                         magnitudeMap[anchor.i    ][anchor.j + 1].B >= magnitudeMap[anchor.i - 1][anchor.j - 1].B &&
-                         magnitudeMap[anchor.i    ][anchor.j + 1].B >= magnitudeMap[anchor.i + 1][anchor.j + 1].B)
+                    gaussianRowHorizontal((const Gray*) gray, buffer.horizontal.row(nextHorizontal % GAUSSIAN_TAPS), cols, weights);
+                }//for
+
+                Gray* smoothed = buffer.smoothed.row(s % SMOOTHED_ROWS);
+
+                if (fullWindow)
                 {
-                    anchor.j     = anchor.j + 1;
-                    anchor.value = magnitudeMap[anchor.i][anchor.j].B;
+                    const Horizontal* window[GAUSSIAN_TAPS];
 
-                    ++currentPixel;
+                    for (int k = 0; k < GAUSSIAN_TAPS; k++)
+                    {
+                        window[k] = buffer.horizontal.row((s - GAUSSIAN_RADIUS + k) % GAUSSIAN_TAPS);
+                    }//for
 
-                    direction = RIGHT;
-                }//else if
+                    gaussianRowVertical(window, smoothed, cols, weights);
+                }//if
                 else
                 {
-                    anchor.i = anchor.i + 1;
-                    anchor.j = anchor.j + 1;
-                    anchor.value = magnitudeMap[anchor.i][anchor.j].B;
+                    gaussianRowFinish((const Horizontal*) buffer.horizontal.row(s % GAUSSIAN_TAPS), smoothed, cols);
+                }//else
 
-                    ++currentPixel;
+                buffer.laps.lap(GAUSSIAN);
+            }//for
 
-                    direction = RIGHT;
-                }//else
-            }//if
-            else //directionMap[anchor.i][anchor.j].B == VERTICAL
+            //the derivatives are 0 on the first and last rows
+            if (m == 0 || m == rows - 1)
             {
-                if (magnitudeMap[anchor.i - 1][anchor.j - 1].B >= magnitudeMap[anchor.i - 1][anchor.j    ].B &&
-                    magnitudeMap[anchor.i - 1][anchor.j - 1].B >= magnitudeMap[anchor.i - 1][anchor.j + 1].B &&
-                    magnitudeMap[anchor.i - 1][anchor.j - 1].B >= magnitudeMap[anchor.i + 1][anchor.j - 1].B &&
-                    magnitudeMap[anchor.i - 1][anchor.j - 1].B >= magnitudeMap[anchor.i + 1][anchor.j    ].B &&
-                    magnitudeMap[anchor.i - 1][anchor.j - 1].B >= magnitudeMap[anchor.i + 1][anchor.j + 1].B)
+                for (int j = 0; j < cols; j++)
                 {
-                    anchor.i     = anchor.i - 1;
-                    anchor.j     = anchor.j - 1;
-                    anchor.value = magnitudeMap[anchor.i][anchor.j].B;
+                    g_x[j] = 0;
+                    g_y[j] = 0;
+                }//for
+            }//if
+            else
+            {
+                derivativeRow((const Gray*) buffer.smoothed.row((m - 1) % SMOOTHED_ROWS),
+                              (const Gray*) buffer.smoothed.row( m      % SMOOTHED_ROWS),
+                              (const Gray*) buffer.smoothed.row((m + 1) % SMOOTHED_ROWS),
+                              g_x, g_y, cols, PREWITT_KERNEL);
+            }//else
 
-                    ++currentPixel;
+            Gray16* magnitude = buffer.magnitude.row(m % MAGNITUDE_ROWS);
+            bool    ownRow    = m >= begin && m < end;
 
-                    direction = UP;
-                }//if
-                else if (magnitudeMap[anchor.i - 1][anchor.j    ].B >= magnitudeMap[anchor.i - 1][anchor.j - 1].B &&
-                         magnitudeMap[anchor.i - 1][anchor.j    ].B >= magnitudeMap[anchor.i - 1][anchor.j + 1].B &&
-                         magnitudeMap[anchor.i - 1][anchor.j    ].B >= magnitudeMap[anchor.i + 1][anchor.j - 1].B &&
-                         magnitudeMap[anchor.i - 1][anchor.j    ].B >= magnitudeMap[anchor.i + 1][anchor.j    ].B &&
-                         magnitudeMap[anchor.i - 1][anchor.j    ].B >= magnitudeMap[anchor.i + 1][anchor.j + 1].B)
-                {
-                    anchor.i     = anchor.i - 1;
-                    anchor.value = magnitudeMap[anchor.i][anchor.j].B;
-
-                    ++currentPixel;
-
-                    direction = UP;
-                }//else if
-                else if (magnitudeMap[anchor.i - 1][anchor.j + 1].B >= magnitudeMap[anchor.i - 1][anchor.j    ].B &&
-                         magnitudeMap[anchor.i - 1][anchor.j + 1].B >= magnitudeMap[anchor.i - 1][anchor.j - 1].B &&
-                         magnitudeMap[anchor.i - 1][anchor.j + 1].B >= magnitudeMap[anchor.i + 1][anchor.j - 1].B &&
-                         magnitudeMap[anchor.i - 1][anchor.j + 1].B >= magnitudeMap[anchor.i + 1][anchor.j    ].B &&
-                         magnitudeMap[anchor.i - 1][anchor.j + 1].B >= magnitudeMap[anchor.i + 1][anchor.j + 1].B)
-                {
-                    anchor.i     = anchor.i - 1;
-                    anchor.j     = anchor.j + 1;
-                    anchor.value = magnitudeMap[anchor.i][anchor.j].B;
-
-                    ++currentPixel;
-
-                    direction = UP;
-                }//else if
-                else if (magnitudeMap[anchor.i + 1][anchor.j - 1].B >= magnitudeMap[anchor.i - 1][anchor.j    ].B &&
-                         magnitudeMap[anchor.i + 1][anchor.j - 1].B >= magnitudeMap[anchor.i - 1][anchor.j + 1].B &&
-                         magnitudeMap[anchor.i + 1][anchor.j - 1].B >= magnitudeMap[anchor.i - 1][anchor.j - 1].B &&
-                         magnitudeMap[anchor.i + 1][anchor.j - 1].B >= magnitudeMap[anchor.i + 1][anchor.j    ].B &&
-                         magnitudeMap[anchor.i + 1][anchor.j - 1].B >= magnitudeMap[anchor.i + 1][anchor.j + 1].B)
-                {
-                    anchor.i     = anchor.i + 1;
-                    anchor.j     = anchor.j - 1;
-                    anchor.value = magnitudeMap[anchor.i][anchor.j].B;
-
-                    ++currentPixel;
-
-                    direction = DOWN;
-                }//else if
-                else if (magnitudeMap[anchor.i + 1][anchor.j    ].B >= magnitudeMap[anchor.i - 1][anchor.j    ].B &&
-                         magnitudeMap[anchor.i + 1][anchor.j    ].B >= magnitudeMap[anchor.i - 1][anchor.j + 1].B &&
-                         magnitudeMap[anchor.i + 1][anchor.j    ].B >= magnitudeMap[anchor.i + 1][anchor.j - 1].B &&
-                         magnitudeMap[anchor.i + 1][anchor.j    ].B >= magnitudeMap[anchor.i - 1][anchor.j - 1].B &&
-                         magnitudeMap[anchor.i + 1][anchor.j    ].B >= magnitudeMap[anchor.i + 1][anchor.j + 1].B)
-                {
-                    anchor.i     = anchor.i + 1;
-                    anchor.value = magnitudeMap[anchor.i][anchor.j].B;
+            prewittRow<BITS>((const Gradient*) g_x, (const Gradient*) g_y, magnitude,
+                             ownRow ? directionMap.row(m) : buffer.direction.row(0), cols);
 
-                    ++currentPixel;
+            if (ownRow)
+            {
+                copy(magnitude, magnitude + cols, magnitudeMap.row(m));
 
-                    direction = DOWN;
-                }//else if
-                else
+                if (countHistogram)
                 {
-                    anchor.i     = anchor.i + 1;
-                    anchor.j     = anchor.j + 1;
-                    anchor.value = magnitudeMap[anchor.i][anchor.j].B;
+                    buffer.histogram.countRow(magnitude, cols);
+                }//if
+            }//if
 
-                    ++currentPixel;
+            buffer.laps.lap(GRADIENT);
 
-                    direction = DOWN;
-                }//else
-            }//else
-        }//if
-        else //else if pixel is not an anchor
+            //the row above now has the magnitude of both of its neighbors
+            int a = m - 1;
+
+            if (a >= max(begin, 1) && a < min(end, rows - 1))
+            {
+                anchorRow<BITS>(buffer.magnitude.row((a - 1) % MAGNITUDE_ROWS),
+                                buffer.magnitude.row( a      % MAGNITUDE_ROWS),
+                                buffer.magnitude.row((a + 1) % MAGNITUDE_ROWS),
+                                directionMap.row(a), anchorMap.row(a), a, cols);
+
+                if (collectAnchors)
+                {
+                    RowAnchors& row = rowAnchors[a];
+
+                    //room for a whole row, so that the anchors can be
+                    //written without counting them first
+                    if (int(buffer.anchors.size()) < buffer.anchorCount + cols)
+                    {
+                        buffer.anchors.resize(max(2*buffer.anchors.size(), size_t(buffer.anchorCount + cols)));
+                    }//if
+
+                    row.thread = thread;
+                    row.first  = buffer.anchorCount;
+                    row.count  = compactAnchorsUnbounded(anchorMap.row(a), cols, buffer.anchors.data() + row.first);
+
+                    buffer.anchorCount += row.count;
+                }//if
+
+                buffer.laps.lap(ANCHORS);
+            }//if
+        }//for
+
+        if (end == rows && rows > 1)
+        {
+            suppressRow(anchorMap.row(rows - 1), rows - 1, cols);
+        }//if
+    }//runRows
+
+    //copies the anchors of every row from the buffer of its thread to its
+    //place in the list, the rows in parallel
+    void gatherAnchors(vector<Anchor>& anchorList)
+    {
+        int rows = int(rowAnchors.size());
+
+        rowOffsets.assign(rows + 1, 0);
+
+        for (int i = 0; i < rows; i++)
+        {
+            rowOffsets[i + 1] = rowOffsets[i] + rowAnchors[i].count;
+        }//for
+
+        anchorList.resize(rowOffsets[rows]);
+
+        parallelForRows(0, rows, 0, [&](int begin, int end)
+        {
+            for (int i = begin; i < end; i++)
+            {
+                const RowAnchors& row     = rowAnchors[i];
+                const Anchor*     anchors = buffers[row.thread].anchors.data() + row.first;
+
+                copy(anchors, anchors + row.count, anchorList.begin() + rowOffsets[i]);
+            }//for
+        });
+    }//gatherAnchors
+
+    vector<Buffers>    buffers;    //one per thread of the pool
+    vector<RowAnchors> rowAnchors; //one per row of the frame
+    vector<int>        rowOffsets; //index of the first anchor of each row in the list
+};//class AnchorPipeline
+
+//the output is usually a view of the frame that is displayed, which has to
+//be the same size as the anchor map
+void convertAnchorToBGR(const ImageView<const Anchor>& anchorMap, const ImageView<BGR8>& output)
+{
+    assert(output.sameSize(anchorMap));
+
+    int rows = anchorMap.rows;
+    int cols = anchorMap.cols;
+
+    for (int i = 0; i < rows; i++)
+    {
+        const Anchor* anchors = anchorMap.row(i);
+        BGR8*         out     = output.row(i);
+
+        for (int j = 0; j < cols; j++)
+        {
+            out[j].B = saturateCast<Gray8>(anchors[j].value);
+            out[j].G = 0;
+            out[j].R = 0;
+        }//for
+    }//for
+}//convertAnchorToBGR
+
+//M is simply the number of non-zero valued pixels in the
+//magnitude map
+float getM(const MagnitudeHistogram& histogram)
+{
+    return float(histogram.nonZero());
+}//getM
+
+float getM(const ImageView<const Gray16>& magnitudeMap, MagnitudeHistograms& threadHistograms)
+{
+    MagnitudeHistogram histogram;
+
+    magnitudeHistogram(magnitudeMap, histogram, threadHistograms);
+
+    return getM(histogram);
+}//getM
+
+//The empircal cumulative distribution is a function H(mu), where mu
+//is the minimum value of a pixel on an edge, and the value H is given by
+//the number of pixels in the magnitude map with values greater than or equal
+//to mu. The function is represented here as a vector. This reduces an O(n)
+//operation to O(1).
+//H(0) is the number of pixels, the other values are divided by M. Both are
+//read from the histogram of the magnitude map, which AnchorPipeline can
+//count while it writes the map. The output keeps its storage from frame to
+//frame.
+void getEmpCumDist(const MagnitudeHistogram& histogram, vector<float>& output)
+{
+    STAGE_TIMER("cdf");
+
+    int64_t atLeast[MAGNITUDE_LEVELS];
+
+    histogram.cumulativeCounts(atLeast);
+
+    output.resize(MAGNITUDE_LEVELS);
+
+    float M = getM(histogram);
+
+    output[0] = float(histogram.pixels());
+
+    for (int k = 1; k < MAGNITUDE_LEVELS; k++)
+    {
+        output[k] = float(atLeast[k])/M;
+    }//for
+}//getEmpCumDist
+
+void getEmpCumDist(const ImageView<const Gray16>& magnitudeMap, MagnitudeHistograms& threadHistograms, vector<float>& output)
+{
+    MagnitudeHistogram histogram;
+
+    magnitudeHistogram(magnitudeMap, histogram, threadHistograms);
+
+    getEmpCumDist(histogram, output);
+}//getEmpCumDist
+
+//Takes all non-zero pixels in the anchor map and puts them in a list
+//to be sorted and accessed in order.
+//the anchors of every row are counted first, in parallel, so that each row
+//knows where its anchors start in the list, and then the rows are copied
+//into the list in parallel. The list is in scan order.
+vector<Anchor> getAnchorList(const ImageView<const Anchor>& anchorMap)
+{
+    int rows = anchorMap.rows;
+    int cols = anchorMap.cols;
+
+    //offsets[i] is the index of the first anchor of row i in the list
+    vector<int> offsets(rows + 1, 0);
+
+    parallelForRows(0, rows, 0, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            offsets[i + 1] = countAnchors(anchorMap.row(i), cols);
+        }//for
+    });
+
+    partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    vector<Anchor> anchorList(offsets[rows]);
+
+    parallelForRows(0, rows, 0, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            compactAnchors(anchorMap.row(i), cols, anchorList.data() + offsets[i]);
+        }//for
+    });
+
+    return anchorList;
+}//getAnchorList
+
+//the key anchors are sorted on. The value of an anchor is its gradient
+//magnitude, which is a Gray16, so the key is exact.
+inline int anchorKey(const Anchor& anchor)
+{
+    return int(anchor.value);
+}//anchorKey
+
+//The anchors of a list grouped by key, strongest first, by a counting sort.
+//The magnitudes are small integers with many repeats, so one bucket per
+//value sorts n anchors in O(n + largest value), and anchors with the same
+//value stay in list order, so the order is the same on every run.
+//The buckets hold the indices of the anchors in the list, so edge linking
+//can go through them bucket by bucket without a sorted copy of the list.
+//The list is split into chunks that are counted and scattered on the
+//thread pool. The chunks only depend on the length of the list.
+class AnchorBuckets
+{
+public:
+    AnchorBuckets() : anchorList(NULL), keys(0) {}
+
+    //the list has to stay unchanged while the buckets are used
+    void build(const vector<Anchor>& anchors, ThreadPool& pool = threadPool())
+    {
+        anchorList = &anchors;
+
+        int size   = int(anchors.size());
+        int chunks = (size + CHUNK - 1)/CHUNK;
+
+        //the largest key sets the number of buckets
+        chunkMax.assign(chunks, 0);
+
+        pool.run(chunks, [&](int chunk)
+        {
+            int largest = 0;
+
+            for (int k = chunk*CHUNK; k < min(size, (chunk + 1)*CHUNK); k++)
+            {
+                largest = max(largest, anchorKey(anchors[k]));
+            }//for
+
+            chunkMax[chunk] = largest;
+        });
+
+        keys = 1;
+
+        for (int chunk = 0; chunk < chunks; chunk++)
+        {
+            keys = max(keys, chunkMax[chunk] + 1);
+        }//for
+
+        //the anchors of each key in each chunk
+        chunkCounts.assign(size_t(chunks)*keys, 0);
+
+        pool.run(chunks, [&](int chunk)
+        {
+            int* counts = &chunkCounts[size_t(chunk)*keys];
+
+            for (int k = chunk*CHUNK; k < min(size, (chunk + 1)*CHUNK); k++)
+            {
+                counts[anchorKey(anchors[k])]++;
+            }//for
+        });
+
+        //the buckets are laid out from the largest key down, and within a
+        //bucket the chunks are in list order. The counts become the position
+        //of the first anchor of each chunk in its bucket.
+        bucketStarts.assign(keys + 1, 0);
+
+        int position = 0;
+
+        for (int key = keys - 1; key >= 0; key--)
+        {
+            bucketStarts[key + 1] = position;
+
+            for (int chunk = 0; chunk < chunks; chunk++)
+            {
+                int& count = chunkCounts[size_t(chunk)*keys + key];
+                int  next  = position + count;
+
+                count    = position;
+                position = next;
+            }//for
+        }//for
+
+        bucketStarts[0] = position;
+
+        order.resize(size);
+
+        pool.run(chunks, [&](int chunk)
+        {
+            int* positions = &chunkCounts[size_t(chunk)*keys];
+
+            for (int k = chunk*CHUNK; k < min(size, (chunk + 1)*CHUNK); k++)
+            {
+                order[positions[anchorKey(anchors[k])]++] = k;
+            }//for
+        });
+    }//build
+
+    //the keys are 0 .. keyCount() - 1
+    int keyCount() const
+    {
+        return keys;
+    }//keyCount
+
+    int bucketSize(int key) const
+    {
+        return bucketStarts[key] - bucketStarts[key + 1];
+    }//bucketSize
+
+    //calls visit(anchor) for the anchors with the given key, in list order
+    template <typename Visit>
+    void forEachInBucket(int key, Visit visit) const
+    {
+        for (int k = bucketStarts[key + 1]; k < bucketStarts[key]; k++)
+        {
+            visit((*anchorList)[order[k]]);
+        }//for
+    }//forEachInBucket
+
+    //calls visit(anchor) for every anchor, strongest first
+    template <typename Visit>
+    void forEachAnchor(Visit visit) const
+    {
+        for (size_t k = 0; k < order.size(); k++)
+        {
+            visit((*anchorList)[order[k]]);
+        }//for
+    }//forEachAnchor
+
+    //copies the anchors to sorted, strongest first, in parallel
+    void sortedList(vector<Anchor>& sorted, ThreadPool& pool = threadPool()) const
+    {
+        int size   = int(order.size());
+        int chunks = (size + CHUNK - 1)/CHUNK;
+
+        sorted.resize(size);
+
+        pool.run(chunks, [&](int chunk)
+        {
+            for (int k = chunk*CHUNK; k < min(size, (chunk + 1)*CHUNK); k++)
+            {
+                sorted[k] = (*anchorList)[order[k]];
+            }//for
+        });
+    }//sortedList
+
+    //sorts the list in place, strongest first. The sorted copy is made in a
+    //buffer that is kept, so buckets that are reused from frame to frame do
+    //not allocate once the buffers have grown. The buckets go on referring
+    //to the list as it was before it was sorted.
+    void sort(vector<Anchor>& anchors, ThreadPool& pool = threadPool())
+    {
+        STAGE_TIMER("sort");
+
+        build(anchors, pool);
+        sortedList(unsorted, pool);
+
+        anchors.swap(unsorted);
+
+        anchorList = &unsorted;
+    }//sort
+
+private:
+    static const int CHUNK = 1 << 16; //anchors per task
+
+    const vector<Anchor>* anchorList;
+
+    int keys;
+
+    vector<int> chunkMax;     //largest key of each chunk
+    vector<int> chunkCounts;  //keys entries per chunk
+    vector<int> bucketStarts; //bucket of key k is order[bucketStarts[k + 1] .. bucketStarts[k] - 1]
+    vector<int> order;        //indices into the list, strongest first
+
+    vector<Anchor> unsorted;  //the list before sort()
+};//class AnchorBuckets
+
+//Links the edge pixels into edges, starting from the anchors.
+//From an anchor, the linker walks both ways along the edge: left and right
+//on a horizontal edge, up and down on a vertical one (diagonal edges are
+//followed like vertical ones). Each step goes to the strongest of the three
+//neighbors ahead, and the walk turns when it reaches a pixel whose edge runs
+//the other way. It stops when none of the neighbors ahead has a magnitude,
+//at the border of the frame, and at pixels that are already on an edge.
+//Every linked pixel is marked in a bitmap, so a pixel goes into at most one
+//edge, an anchor that is already on an edge does not start another one,
+//and a closed contour ends where it started. The work per frame is
+//proportional to the number of edge pixels.
+template <int BITS>
+class EdgeLinker
+{
+public:
+    //replaces the contents of edgeList with the edges through the anchors
+    //of the list, the anchors are tried in the order of the list
+    void extractEdges(const vector<Anchor>&          anchorList,
+                      const ImageView<const Gray16>& magnitudeMap,
+                      const PackedDirections<BITS>&  directionMap,
+                      EdgeList&                      edgeList)
+    {
+        STAGE_TIMER("linking");
+
+        visited.create(magnitudeMap.rows, magnitudeMap.cols);
+        visited.clear();
+
+        edgeList.clear();
+
+        for (size_t k = 0; k < anchorList.size(); k++)
+        {
+            getEdgePixels(anchorList[k].i, anchorList[k].j, magnitudeMap, directionMap, edgeList);
+        }//for
+    }//extractEdges
+
+private:
+    enum Movement
+    {
+        UP,
+        DOWN,
+        LEFT,
+        RIGHT
+    };//enum Movement
+
+    //the edge through the anchor at (i, j), if it is not on one already
+    void getEdgePixels(int i, int j,
+                       const ImageView<const Gray16>& magnitudeMap,
+                       const PackedDirections<BITS>&  directionMap,
+                       EdgeList&                      edgeList)
+    {
+        if (strength(i, j, magnitudeMap) == 0)
+        {
+            return;
+        }//if
+
+        bool horizontal = directionMap(i, j) == HORIZONTAL_EDGE;
+
+        visited.set(i, j, 1);
+
+        //the first half is walked away from the anchor, and turned around
+        //so that the edge runs through the anchor into the second half
+        walk(i, j, horizontal ? LEFT : UP, magnitudeMap, directionMap, edgeList);
+
+        edgeList.reverseOpenEdge();
+        edgeList.addPixel(edgePixel(i, j, magnitudeMap));
+
+        walk(i, j, horizontal ? RIGHT : DOWN, magnitudeMap, directionMap, edgeList);
+
+        edgeList.closeEdge();
+    }//getEdgePixels
+
+    void walk(int i, int j, Movement movement,
+              const ImageView<const Gray16>& magnitudeMap,
+              const PackedDirections<BITS>&  directionMap,
+              EdgeList&                      edgeList)
+    {
+        while (true)
+        {
+            //turn towards the stronger side if the edge changed direction
+            bool horizontal = directionMap(i, j) == HORIZONTAL_EDGE;
+
+            if (horizontal && (movement == UP || movement == DOWN))
+            {
+                movement = strongerSide(i, j, LEFT, RIGHT, magnitudeMap);
+            }//if
+            else if (!horizontal && (movement == LEFT || movement == RIGHT))
+            {
+                movement = strongerSide(i, j, UP, DOWN, magnitudeMap);
+            }//else if
+
+            int nextI;
+            int nextJ;
+
+            if (ahead(i, j, movement, magnitudeMap, nextI, nextJ) == 0)
+            {
+                return;
+            }//if
+
+            i = nextI;
+            j = nextJ;
+
+            visited.set(i, j, 1);
+
+            edgeList.addPixel(edgePixel(i, j, magnitudeMap));
+        }//while
+    }//walk
+
+    //the strongest of the three neighbors of (i, j) in the direction of the
+    //movement goes to (nextI, nextJ), and its strength is returned. The one
+    //straight ahead wins a tie.
+    int ahead(int i, int j, Movement movement, const ImageView<const Gray16>& magnitudeMap, int& nextI, int& nextJ)
+    {
+        //straight ahead, and the step to the two neighbors beside it
+        int stepI = movement == UP   ? -1 : movement == DOWN  ? 1 : 0;
+        int stepJ = movement == LEFT ? -1 : movement == RIGHT ? 1 : 0;
+        int sideI = stepJ != 0 ? 1 : 0;
+        int sideJ = stepI != 0 ? 1 : 0;
+
+        nextI = i + stepI;
+        nextJ = j + stepJ;
+
+        int best = strength(nextI, nextJ, magnitudeMap);
+
+        for (int side = -1; side <= 1; side += 2)
+        {
+            int sideStrength = strength(i + stepI + side*sideI, j + stepJ + side*sideJ, magnitudeMap);
+
+            if (sideStrength > best)
+            {
+                best  = sideStrength;
+                nextI = i + stepI + side*sideI;
+                nextJ = j + stepJ + side*sideJ;
+            }//if
+        }//for
+
+        return best;
+    }//ahead
+
+    Movement strongerSide(int i, int j, Movement first, Movement second, const ImageView<const Gray16>& magnitudeMap)
+    {
+        int nextI;
+        int nextJ;
+
+        if (ahead(i, j, first, magnitudeMap, nextI, nextJ) >= ahead(i, j, second, magnitudeMap, nextI, nextJ))
+        {
+            return first;
+        }//if
+
+        return second;
+    }//strongerSide
+
+    //the magnitude of a pixel that can still be linked, 0 for the border
+    //and for pixels that are already on an edge. The walk never leaves the
+    //pixels inside the border, so their neighbors are always in the frame.
+    int strength(int i, int j, const ImageView<const Gray16>& magnitudeMap) const
+    {
+        if (i < 1 || i >= magnitudeMap.rows - 1 || j < 1 || j >= magnitudeMap.cols - 1)
+        {
+            return 0;
+        }//if
+
+        if (visited(i, j) != 0)
+        {
+            return 0;
+        }//if
+
+        return magnitudeMap(i, j);
+    }//strength
+
+    static Anchor edgePixel(int i, int j, const ImageView<const Gray16>& magnitudeMap)
+    {
+        Anchor pixel;
+
+        pixel.value = magnitudeMap(i, j);
+        pixel.i     = i;
+        pixel.j     = j;
+
+        return pixel;
+    }//edgePixel
+
+    PackedDirections<1> visited; //pixels that are on an edge
+};//class EdgeLinker
+
+//*****************************************************************************
+//line detection
+//
+//the edges are split into straight line segments the way EDLines does it:
+//a line is fitted to the first MIN_LINE_LENGTH pixels of an edge, and grows
+//a pixel at a time while the next pixel stays within LINE_MAX_ERROR of it.
+//The fit is kept in running sums, so every edge is walked once, and a
+//segment refers to its pixels in the edge list instead of copying them.
+//A segment is a line if it is meaningful a contrario, like in the parameter
+//free validation of edge segments. n pixels whose smallest magnitude is mu
+//are expected to turn up by chance
+//
+//  NFA = (rows*cols)^2 * H(mu)^(n/2)
+//
+//times in a frame, H being the empirical cumulative distribution of the
+//magnitudes. Only every other pixel counts, as the magnitudes of neighbors
+//are not independent.
+//*****************************************************************************
+
+//line segments
+const int   MIN_LINE_LENGTH = 8;   //pixels
+const float LINE_MAX_ERROR  = 1.0; //distance in pixels from the fitted line
+const float LINE_MIN_NFA    = 0;   //-log10 of the number of false alarms a line can have at most (1)
+
+//a straight run of pixels first .. last of an edge
+struct LineSegment
+{
+    int   edge;
+    int   first;
+    int   last;
+    float x1; //ends of the fitted line, at the first and last pixel
+    float y1;
+    float x2;
+    float y2;
+    float mu; //the smallest magnitude of its pixels
+};//struct LineSegment
+
+//total least squares line through a set of points, from their sums, so a
+//line can be extended by a point in constant time. x is the column and y
+//the row of a pixel.
+class LineFit
+{
+public:
+    LineFit() : n(0), sx(0), sy(0), sxx(0), syy(0), sxy(0) {}
+
+    void add(double x, double y)
+    {
+        n   += 1;
+        sx  += x;
+        sy  += y;
+        sxx += x*x;
+        syy += y*y;
+        sxy += x*y;
+    }//add
+
+    //the mean squared distance of the points from the line, which is the
+    //smaller eigenvalue of their covariance
+    double meanSquaredError() const
+    {
+        double cxx, cyy, cxy;
+
+        covariance(cxx, cyy, cxy);
+
+        return 0.5*(cxx + cyy - sqrt((cxx - cyy)*(cxx - cyy) + 4*cxy*cxy));
+    }//meanSquaredError
+
+    double distance(double x, double y) const
+    {
+        double cxx, cyy, cxy;
+
+        covariance(cxx, cyy, cxy);
+
+        //the normal of the line is perpendicular to the main axis
+        double angle = 0.5*atan2(2*cxy, cxx - cyy);
+
+        return abs(-(x - sx/n)*sin(angle) + (y - sy/n)*cos(angle));
+    }//distance
+
+    //the point of the line closest to (x, y)
+    void project(double x, double y, float& lineX, float& lineY) const
+    {
+        double cxx, cyy, cxy;
+
+        covariance(cxx, cyy, cxy);
+
+        double angle = 0.5*atan2(2*cxy, cxx - cyy);
+        double t     = (x - sx/n)*cos(angle) + (y - sy/n)*sin(angle);
+
+        lineX = float(sx/n + t*cos(angle));
+        lineY = float(sy/n + t*sin(angle));
+    }//project
+
+private:
+    void covariance(double& cxx, double& cyy, double& cxy) const
+    {
+        cxx = sxx/n - (sx/n)*(sx/n);
+        cyy = syy/n - (sy/n)*(sy/n);
+        cxy = sxy/n - (sx/n)*(sy/n);
+    }//covariance
+
+    double n, sx, sy, sxx, syy, sxy;
+};//class LineFit
+
+
+struct Line
+{
+    float x1; //column and row of the two ends
+    float y1;
+    float x2;
+    float y2;
+    float nfa; //-log10 of the number of false alarms, the higher the more meaningful
+};//struct Line
+
+//finds the lines made by the edges of a frame. The buffers are kept from
+//frame to frame.
+class LineDetector
+{
+public:
+    //splits the edges of a rows x cols frame into line segments, and
+    //replaces the contents of lines with the segments that are meaningful.
+    //empCumDist is H, from getEmpCumDist().
+    void detect(const EdgeList& edgeList, const vector<float>& empCumDist, int rows, int cols, vector<Line>& lines)
+    {
+        STAGE_TIMER("lines");
+
+        segments.clear();
+
+        for (int edge = 0; edge < edgeList.edgeCount(); edge++)
+        {
+            splitEdge(edgeList, edge);
+        }//for
+
+        //log10 of the number of segments a frame has, (rows*cols)^2
+        double logSegments = 2*log10(double(rows)*cols);
+
+        lines.clear();
+
+        for (size_t s = 0; s < segments.size(); s++)
+        {
+            const LineSegment& segment = segments[s];
+
+            float H = empCumDist[min(int(segment.mu), MAGNITUDE_LEVELS - 1)];
+
+            if (!(H > 0))
+            {
+                continue;
+            }//if
+
+            Line line;
+
+            line.x1  = segment.x1;
+            line.y1  = segment.y1;
+            line.x2  = segment.x2;
+            line.y2  = segment.y2;
+            line.nfa = float(-logSegments - 0.5*(segment.last - segment.first + 1)*log10(H));
+
+            if (line.nfa > LINE_MIN_NFA)
+            {
+                lines.push_back(line);
+            }//if
+        }//for
+    }//detect
+
+    //all of the segments of the last frame, meaningful or not, edge by edge.
+    //The circle detector is built from them.
+    const vector<LineSegment>& lineSegments() const
+    {
+        return segments;
+    }//lineSegments
+
+private:
+    //splits an edge into segments that stay within LINE_MAX_ERROR of a line.
+    //A segment starts as the first MIN_LINE_LENGTH pixels that fit a line,
+    //and grows a pixel at a time while the next pixel is close to it.
+    void splitEdge(const EdgeList& edgeList, int edge)
+    {
+        const Anchor* pixels = edgeList.edge(edge);
+        int           length = edgeList.length(edge);
+
+        const double MAX_ERROR_2 = LINE_MAX_ERROR*LINE_MAX_ERROR;
+
+        int first = 0;
+
+        while (first + MIN_LINE_LENGTH <= length)
+        {
+            LineFit fit;
+
+            for (int k = first; k < first + MIN_LINE_LENGTH; k++)
+            {
+                fit.add(pixels[k].j, pixels[k].i);
+            }//for
+
+            if (fit.meanSquaredError() > MAX_ERROR_2)
+            {
+                first++;
+
+                continue;
+            }//if
+
+            int   end = first + MIN_LINE_LENGTH;
+            float mu  = pixels[first].value;
+
+            for (int k = first + 1; k < end; k++)
+            {
+                mu = min(mu, pixels[k].value);
+            }//for
+
+            while (end < length && fit.distance(pixels[end].j, pixels[end].i) <= LINE_MAX_ERROR)
+            {
+                fit.add(pixels[end].j, pixels[end].i);
+
+                mu = min(mu, pixels[end].value);
+                end++;
+            }//while
+
+            LineSegment segment;
+
+            segment.edge  = edge;
+            segment.first = first;
+            segment.last  = end - 1;
+            segment.mu    = mu;
+
+            fit.project(pixels[first  ].j, pixels[first  ].i, segment.x1, segment.y1);
+            fit.project(pixels[end - 1].j, pixels[end - 1].i, segment.x2, segment.y2);
+
+            segments.push_back(segment);
+
+            first = end;
+        }//while
+    }//splitEdge
+
+    vector<LineSegment> segments;
+};//class LineDetector
+
+//*****************************************************************************
+//circle detection
+//
+//once we have extracted the edges, we apply a circular arc detection
+//algorithm, and then use that to get the x-y locations of balls in the image.
+//runs of the line segments of an edge that keep turning the same way by
+//moderate angles are taken as circular arcs, a circle is fitted to every
+//arc, and arcs that lie on the same circle are joined. The circles an arc
+//can join are looked up in a hash by center and radius, so all of it is
+//linear in the number of edge pixels.
+//*****************************************************************************
+
+//arcs, the angles are in degrees
+const float ARC_MIN_TURN = 6;  //between consecutive segments of an arc
+const float ARC_MAX_TURN = 60;
+const int   ARC_MAX_GAP  = 3;  //edge pixels between consecutive segments
+
+//circles
+const float CIRCLE_MAX_ERROR       = 1.5;  //rms distance in pixels of an arc from its circle
+const float CIRCLE_MIN_RADIUS      = 4;
+const float CIRCLE_MERGE_TOLERANCE = 0.25; //of the radius, between the centers and radii of arcs of one circle
+const float CIRCLE_MIN_SCORE       = 0.5;  //part of the circumference that has to be covered by edges
+const int   CIRCLE_MAX_BINS        = 360;  //the circumference is scored in bins of about a pixel
+
+struct Circle
+{
+    float cx;    //center column
+    float cy;    //center row
+    float r;     //radius in pixels
+    float score; //part of the circumference that is covered by edge pixels, 0..1
+};//struct Circle
+
+//algebraic (Kasa) least squares circle through a set of points, from their
+//sums, so an arc can be extended by a point, or two arcs joined, in constant
+//time. The points are taken relative to an origin near them, which keeps
+//the sums of cubes well inside the precision of a double.
+class CircleFit
+{
+public:
+    CircleFit(double originX = 0, double originY = 0)
+        : originX(originX), originY(originY), n(0), sx(0), sy(0), sxx(0), syy(0), sxy(0), sxz(0), syz(0), sz(0) {}
+
+    void add(double x, double y)
+    {
+        x -= originX;
+        y -= originY;
+
+        double z = x*x + y*y;
+
+        n   += 1;
+        sx  += x;
+        sy  += y;
+        sxx += x*x;
+        syy += y*y;
+        sxy += x*y;
+        sxz += x*z;
+        syz += y*z;
+        sz  += z;
+    }//add
+
+    //the fits have to have the same origin
+    void merge(const CircleFit& other)
+    {
+        n   += other.n;
+        sx  += other.sx;
+        sy  += other.sy;
+        sxx += other.sxx;
+        syy += other.syy;
+        sxy += other.sxy;
+        sxz += other.sxz;
+        syz += other.syz;
+        sz  += other.sz;
+    }//merge
+
+    //the circle x^2 + y^2 + D*x + E*y + F = 0 that fits the points best,
+    //false if they are on a line
+    bool solve(float& cx, float& cy, float& r) const
+    {
+        //the normal equations
+        //[sxx sxy sx] [D]   [sxz]
+        //[sxy syy sy] [E] = -[syz]
+        //[sx  sy  n ] [F]   [sz ]
+        double det = sxx*(syy*n - sy*sy) - sxy*(sxy*n - sy*sx) + sx*(sxy*sy - syy*sx);
+
+        if (abs(det) < 1e-9*n*n*n)
+        {
+            return false;
+        }//if
+
+        double detD = -sxz*(syy*n - sy*sy) + sxy*(syz*n - sy*sz) - sx*(syz*sy - syy*sz);
+        double detE = -sxx*(syz*n - sy*sz) + sxz*(sxy*n - sy*sx) - sx*(sxy*sz - syz*sx);
+        double detF = -sxx*(syy*sz - syz*sy) + sxy*(sxy*sz - syz*sx) - sxz*(sxy*sy - syy*sx);
+
+        double D = detD/det;
+        double E = detE/det;
+        double F = detF/det;
+
+        double centerX = -D/2;
+        double centerY = -E/2;
+        double radius2 = centerX*centerX + centerY*centerY - F;
+
+        if (!(radius2 > 0))
+        {
+            return false;
+        }//if
+
+        cx = float(centerX + originX);
+        cy = float(centerY + originY);
+        r  = float(sqrt(radius2));
+
+        return true;
+    }//solve
+
+private:
+    double originX, originY;
+    double n, sx, sy, sxx, syy, sxy, sxz, syz, sz;
+};//class CircleFit
+
+//circles hashed by their center and radius, to find the ones that a circle
+//is within CIRCLE_MERGE_TOLERANCE of their radius of. The radii are put in
+//levels by powers of 2, and the centers of a level in square cells as large
+//as the largest tolerance of the level, so such a circle is in one of the
+//levels its radius can be in, in the cell of the center or next to it.
+//Circles are numbered by the caller, from 0 to the capacity given to
+//reset(). The buffers are kept from frame to frame.
+class CircleHash
+{
+public:
+    //empties the hash, for circles numbered 0 .. capacity - 1
+    void reset(int capacity)
+    {
+        int size = 16;
+
+        while (size < 2*capacity)
+        {
+            size *= 2;
+        }//while
+
+        heads.assign(size, -1);
+        next .assign(capacity, -1);
+        slots.assign(capacity, -1);
+    }//reset
+
+    void insert(int id, float cx, float cy, float r)
+    {
+        int level = ilogb(r);
+        int size  = cellSize(level);
+
+        int s = slot(level, cell(cx, size), cell(cy, size));
+
+        next [id] = heads[s];
+        heads[s]  = id;
+        slots[id] = s;
+    }//insert
+
+    void remove(int id)
+    {
+        int* link = &heads[slots[id]];
+
+        while (*link != id)
+        {
+            link = &next[*link];
+        }//while
+
+        *link     = next[id];
+        slots[id] = -1;
+    }//remove
+
+    //replaces the contents of ids with the circles that (cx, cy, r) can be
+    //within tolerance of, in increasing order. Others that share a slot of
+    //the hash with them can be among them.
+    void near(float cx, float cy, float r, vector<int>& ids) const
+    {
+        ids.clear();
+
+        //|r - other| <= tolerance*other, a little wider for the rounding
+        int lowest  = ilogb(r/(1 + CIRCLE_MERGE_TOLERANCE)*0.999f);
+        int highest = ilogb(r/(1 - CIRCLE_MERGE_TOLERANCE)*1.001f);
+
+        for (int level = lowest; level <= highest; level++)
         {
-            if (direction == LEFT)
+            int size = cellSize(level);
+            int x    = cell(cx, size);
+            int y    = cell(cy, size);
+
+            for (int dy = -1; dy <= 1; dy++)
             {
-                if (magnitudeMap[anchor.i - 1][anchor.j - 1].B >= magnitudeMap[anchor.i    ][anchor.j - 1].B &&
-                    magnitudeMap[anchor.i - 1][anchor.j - 1].B >= magnitudeMap[anchor.i + 1][anchor.j - 1].B)
+                for (int dx = -1; dx <= 1; dx++)
                 {
-                    anchor.i     = anchor.i - 1;
-                    anchor.j     = anchor.j - 1;
-                    anchor.value = magnitudeMap[anchor.i][anchor.j].B;
+                    for (int id = heads[slot(level, x + dx, y + dy)]; id >= 0; id = next[id])
+                    {
+                        ids.push_back(id);
+                    }//for
+                }//for
+            }//for
+        }//for
 
-                    ++currentPixel;
-                }//if
-                else if (magnitudeMap[anchor.i    ][anchor.j - 1].B >= magnitudeMap[anchor.i - 1][anchor.j - 1].B &&
-                         magnitudeMap[anchor.i    ][anchor.j - 1].B >= magnitudeMap[anchor.i + 1][anchor.j - 1].B)
-                {
-                    anchor.j     = anchor.j - 1;
-                    anchor.value = magnitudeMap[anchor.i][anchor.j].B;
+        sort(ids.begin(), ids.end());
 
-                    ++currentPixel;
-                }//else if
-                else
-                {
-                    anchor.i     = anchor.i + 1;
-                    anchor.j     = anchor.j - 1;
-                    anchor.value = magnitudeMap[anchor.i][anchor.j].B;
+        ids.erase(unique(ids.begin(), ids.end()), ids.end());
+    }//near
 
-                    ++currentPixel;
-                }//else
+private:
+    //the cells of a level are as large as the tolerance of a radius just
+    //below the next level, at least 1
+    static int cellSize(int level)
+    {
+        return max(1, int(ceil(ldexp(CIRCLE_MERGE_TOLERANCE, level + 1))));
+    }//cellSize
+
+    static int cell(float x, int size)
+    {
+        return int(floor(x/size));
+    }//cell
+
+    int slot(int level, int x, int y) const
+    {
+        unsigned hash = unsigned(level)*73856093u ^ unsigned(x)*19349663u ^ unsigned(y)*83492791u;
+
+        return int(hash & unsigned(heads.size() - 1));
+    }//slot
+
+    vector<int> heads; //first circle of each slot, -1 if none
+    vector<int> next;  //next circle in the slot of each circle
+    vector<int> slots; //slot of each circle, -1 if it is not in the hash
+};//class CircleHash
+
+//finds the circles made by the edges of a frame. The buffers are kept from
+//frame to frame.
+class CircleDetector
+{
+public:
+    //replaces the contents of circles with the circles found in the edges
+    //of a rows x cols frame, best score first. The segments are those of
+    //the edges, edge by edge, from LineDetector::lineSegments().
+    void detect(const EdgeList& edgeList, const vector<LineSegment>& lineSegments, int rows, int cols,
+                vector<Circle>& circles)
+    {
+        STAGE_TIMER("circles");
+
+        originX = 0.5*cols;
+        originY = 0.5*rows;
+
+        maxRadius = float(max(rows, cols));
+
+        segments = &lineSegments;
+
+        arcs      .clear();
+        candidates.clear();
+
+        int count = int(lineSegments.size());
+
+        for (int begin = 0, end = 0; begin < count; begin = end)
+        {
+            while (end < count && lineSegments[end].edge == lineSegments[begin].edge)
+            {
+                end++;
+            }//while
+
+            findArcs(edgeList, begin, end);
+        }//for
+
+        joinArcs(edgeList);
+        scoreCircles(edgeList, circles);
+    }//detect
+
+private:
+    //a run of segments that turn the same way, pixels first .. last of an edge
+    struct Arc
+    {
+        int       edge;
+        int       first;
+        int       last;
+        CircleFit fit;
+        float     cx;
+        float     cy;
+        float     r;
+    };//struct Arc
+
+    //arcs that are taken to be on the same circle
+    struct Candidate
+    {
+        CircleFit fit;
+        float     cx;
+        float     cy;
+        float     r;
+    };//struct Candidate
+
+    //the signed angle in degrees from the direction of one segment to the
+    //direction of the next
+    static float turn(const LineSegment& from, const LineSegment& to)
+    {
+        double ax = from.x2 - from.x1;
+        double ay = from.y2 - from.y1;
+        double bx = to.x2   - to.x1;
+        double by = to.y2   - to.y1;
+
+        return float(atan2(ax*by - ay*bx, ax*bx + ay*by)*180/CV_PI);
+    }//turn
+
+    //groups the segments begin .. end - 1 of one edge into arcs. An arc is a
+    //run of at least two segments that follow each other closely, and turn
+    //by ARC_MIN_TURN .. ARC_MAX_TURN degrees, all in the same direction.
+    void findArcs(const EdgeList& edgeList, int begin, int end)
+    {
+        int   runBegin = begin;
+        float runTurn  = 0;
+
+        for (int s = begin + 1; s <= end; s++)
+        {
+            bool  joins = false;
+            float angle = 0;
+
+            if (s < end && (*segments)[s].first - (*segments)[s - 1].last - 1 <= ARC_MAX_GAP)
+            {
+                angle = turn((*segments)[s - 1], (*segments)[s]);
+
+                joins = abs(angle) >= ARC_MIN_TURN && abs(angle) <= ARC_MAX_TURN;
             }//if
-            else if (direction == RIGHT)
+
+            if (joins && (s - 1 == runBegin || (angle > 0) == (runTurn > 0)))
             {
-                if (magnitudeMap[anchor.i - 1][anchor.j + 1].B >= magnitudeMap[anchor.i    ][anchor.j + 1].B &&
-                    magnitudeMap[anchor.i - 1][anchor.j + 1].B >= magnitudeMap[anchor.i + 1][anchor.j + 1].B)
-                {
-                    anchor.i     = anchor.i - 1;
-                    anchor.j     = anchor.j + 1;
-                    anchor.value = magnitudeMap[anchor.i][anchor.j].B;
+                runTurn = angle;
 
-                    ++currentPixel;
-                }//if
-                else if (magnitudeMap[anchor.i    ][anchor.j + 1].B >= magnitudeMap[anchor.i - 1][anchor.j + 1].B &&
-                         magnitudeMap[anchor.i    ][anchor.j + 1].B >= magnitudeMap[anchor.i + 1][anchor.j + 1].B)
-                {
-                    anchor.j     = anchor.j + 1;
-                    anchor.value = magnitudeMap[anchor.i][anchor.j].B;
+                continue;
+            }//if
 
-                    ++currentPixel;
-                }//else if
-                else
-                {
-                    anchor.i     = anchor.i + 1;
-                    anchor.j     = anchor.j + 1;
-                    anchor.value = magnitudeMap[anchor.i][anchor.j].B;
+            addArc(edgeList, runBegin, s);
 
-                    ++currentPixel;
-                }//else
-            }//else if
-            else if (direction == UP)
+            //a turn the other way can still start an arc with the last segment
+            runBegin = joins ? s - 1 : s;
+            runTurn  = angle;
+        }//for
+    }//findArcs
+
+    //the arc of segments begin .. end - 1, if there are at least two and a
+    //circle fits them
+    void addArc(const EdgeList& edgeList, int begin, int end)
+    {
+        if (end - begin < 2)
+        {
+            return;
+        }//if
+
+        Arc arc;
+
+        arc.edge  = (*segments)[begin].edge;
+        arc.first = (*segments)[begin].first;
+        arc.last  = (*segments)[end - 1].last;
+        arc.fit   = CircleFit(originX, originY);
+
+        const Anchor* pixels = edgeList.edge(arc.edge);
+
+        for (int k = arc.first; k <= arc.last; k++)
+        {
+            arc.fit.add(pixels[k].j, pixels[k].i);
+        }//for
+
+        if (!arc.fit.solve(arc.cx, arc.cy, arc.r))
+        {
+            return;
+        }//if
+
+        if (arc.r < CIRCLE_MIN_RADIUS || arc.r > maxRadius)
+        {
+            return;
+        }//if
+
+        if (rmsDistance(edgeList, arc, arc.cx, arc.cy, arc.r) > CIRCLE_MAX_ERROR)
+        {
+            return;
+        }//if
+
+        arcs.push_back(arc);
+    }//addArc
+
+    static int circleBins(float r)
+    {
+        return max(8, min(CIRCLE_MAX_BINS, int(2*CV_PI*r)));
+    }//circleBins
+
+    //the rms distance of the pixels of an arc from a circle
+    static double rmsDistance(const EdgeList& edgeList, const Arc& arc, float cx, float cy, float r)
+    {
+        const Anchor* pixels = edgeList.edge(arc.edge);
+
+        double sum = 0;
+
+        for (int k = arc.first; k <= arc.last; k++)
+        {
+            double d = hypot(pixels[k].j - cx, pixels[k].i - cy) - r;
+
+            sum += d*d;
+        }//for
+
+        return sqrt(sum/(arc.last - arc.first + 1));
+    }//rmsDistance
+
+    //joins the arcs into circles, the longest arcs first. An arc joins the
+    //first circle whose center and radius are close to its own, if the
+    //circle fitted to both still fits the arc.
+    void joinArcs(const EdgeList& edgeList)
+    {
+        sortArcs();
+
+        circleOfArc.assign(arcs.size(), -1);
+
+        candidateHash.reset(int(arcs.size()));
+
+        for (size_t k = 0; k < order.size(); k++)
+        {
+            const Arc& arc = arcs[order[k]];
+
+            int joined = -1;
+
+            candidateHash.near(arc.cx, arc.cy, arc.r, nearby);
+
+            for (size_t n = 0; n < nearby.size() && joined < 0; n++)
             {
-                if (magnitudeMap[anchor.i - 1][anchor.j - 1].B >= magnitudeMap[anchor.i - 1][anchor.j    ].B &&
-                    magnitudeMap[anchor.i - 1][anchor.j - 1].B >= magnitudeMap[anchor.i - 1][anchor.j + 1].B)
-                {
-                    anchor.i     = anchor.i - 1;
-                    anchor.j     = anchor.j - 1;
-                    anchor.value = magnitudeMap[anchor.i][anchor.j].B;
+                int        c         = nearby[n];
+                Candidate& candidate = candidates[c];
 
-                    ++currentPixel;
-                }//if
-                else if (magnitudeMap[anchor.i - 1][anchor.j    ].B >= magnitudeMap[anchor.i - 1][anchor.j - 1].B &&
-                         magnitudeMap[anchor.i - 1][anchor.j    ].B >= magnitudeMap[anchor.i - 1][anchor.j + 1].B)
+                float tolerance = CIRCLE_MERGE_TOLERANCE*candidate.r;
+
+                if (hypot(arc.cx - candidate.cx, arc.cy - candidate.cy) > tolerance ||
+                    abs(arc.r - candidate.r) > tolerance)
                 {
-                    anchor.i     = anchor.i - 1;
-                    anchor.value = magnitudeMap[anchor.i][anchor.j].B;
+                    continue;
+                }//if
 
-                    ++currentPixel;
-                }//else if
-                else
+                CircleFit fit = candidate.fit;
+                float     cx, cy, r;
+
+                fit.merge(arc.fit);
+
+                if (fit.solve(cx, cy, r) && rmsDistance(edgeList, arc, cx, cy, r) <= CIRCLE_MAX_ERROR)
                 {
-                    anchor.i     = anchor.i - 1;
-                    anchor.j     = anchor.j + 1;
-                    anchor.value = magnitudeMap[anchor.i][anchor.j].B;
+                    candidateHash.remove(c);
 
-                    ++currentPixel;
-                }//else
-            }//else if
-            else //direction == DOWN
+                    candidate.fit = fit;
+                    candidate.cx  = cx;
+                    candidate.cy  = cy;
+                    candidate.r   = r;
+
+                    candidateHash.insert(c, cx, cy, r);
+
+                    joined = c;
+                }//if
+            }//for
+
+            if (joined < 0)
+            {
+                Candidate candidate;
+
+                candidate.fit = arc.fit;
+                candidate.cx  = arc.cx;
+                candidate.cy  = arc.cy;
+                candidate.r   = arc.r;
+
+                joined = int(candidates.size());
+
+                candidates.push_back(candidate);
+
+                candidateHash.insert(joined, arc.cx, arc.cy, arc.r);
+            }//if
+
+            circleOfArc[order[k]] = joined;
+        }//for
+    }//joinArcs
+
+    //puts the arcs in order, longest first and in the order they were found
+    //among arcs of the same length, by a counting sort on the length
+    void sortArcs()
+    {
+        int longest = 0;
+
+        for (size_t k = 0; k < arcs.size(); k++)
+        {
+            longest = max(longest, arcs[k].last - arcs[k].first);
+        }//for
+
+        lengthStarts.assign(longest + 2, 0);
+
+        for (size_t k = 0; k < arcs.size(); k++)
+        {
+            lengthStarts[longest - (arcs[k].last - arcs[k].first) + 1]++;
+        }//for
+
+        partial_sum(lengthStarts.begin(), lengthStarts.end(), lengthStarts.begin());
+
+        order.resize(arcs.size());
+
+        for (size_t k = 0; k < arcs.size(); k++)
+        {
+            order[lengthStarts[longest - (arcs[k].last - arcs[k].first)]++] = int(k);
+        }//for
+    }//sortArcs
+
+    //the score of a circle is the part of its circumference that pixels of
+    //its arcs are on, within CIRCLE_MAX_ERROR. The circumference is divided
+    //into bins by angle, so the parallel edges of a blurred outline are not
+    //counted twice.
+    void scoreCircles(const EdgeList& edgeList, vector<Circle>& circles)
+    {
+        binOffsets.assign(candidates.size() + 1, 0);
+
+        for (size_t c = 0; c < candidates.size(); c++)
+        {
+            binOffsets[c + 1] = binOffsets[c] + circleBins(candidates[c].r);
+        }//for
+
+        covered.assign(binOffsets.back(), 0);
+
+        for (size_t a = 0; a < arcs.size(); a++)
+        {
+            const Arc&       arc       = arcs[a];
+            const Candidate& candidate = candidates[circleOfArc[a]];
+            const Anchor*    pixels    = edgeList.edge(arc.edge);
+
+            int bins  = circleBins(candidate.r);
+            int first = binOffsets[circleOfArc[a]];
+
+            for (int k = arc.first; k <= arc.last; k++)
             {
-                if (magnitudeMap[anchor.i + 1][anchor.j - 1].B >= magnitudeMap[anchor.i + 1][anchor.j    ].B &&
-                    magnitudeMap[anchor.i + 1][anchor.j - 1].B >= magnitudeMap[anchor.i + 1][anchor.j + 1].B)
+                double x = pixels[k].j - candidate.cx;
+                double y = pixels[k].i - candidate.cy;
+
+                if (abs(hypot(x, y) - candidate.r) <= CIRCLE_MAX_ERROR)
                 {
-                    anchor.i     = anchor.i + 1;
-                    anchor.j     = anchor.j - 1;
-                    anchor.value = magnitudeMap[anchor.i][anchor.j].B;
+                    int bin = int((atan2(y, x) + CV_PI)/(2*CV_PI)*bins);
 
-                    ++currentPixel;
+                    covered[first + min(bin, bins - 1)] = 1;
                 }//if
-                else if (magnitudeMap[anchor.i + 1][anchor.j    ].B >= magnitudeMap[anchor.i + 1][anchor.j - 1].B &&
-                         magnitudeMap[anchor.i + 1][anchor.j    ].B >= magnitudeMap[anchor.i + 1][anchor.j + 1].B)
-                {
-                    anchor.i     = anchor.i + 1;
-                    anchor.value = magnitudeMap[anchor.i][anchor.j].B;
+            }//for
+        }//for
 
-                    ++currentPixel;
-                }//else if
-                else
-                {
-                    anchor.i     = anchor.i + 1;
-                    anchor.j     = anchor.j + 1;
-                    anchor.value = magnitudeMap[anchor.i][anchor.j].B;
+        //the candidates that score high enough, best first, and in the
+        //order they were found among equal scores
+        scores.resize(candidates.size());
+        ranked.clear();
 
-                    ++currentPixel;
-                }//else
-            }
-        }//else
-    }//while
-}//getEdgePixels
+        for (size_t c = 0; c < candidates.size(); c++)
+        {
+            scores[c] = float(count(covered.begin() + binOffsets[c], covered.begin() + binOffsets[c + 1], 1))/
+                        (binOffsets[c + 1] - binOffsets[c]);
 
-//This function extracts edges from our maps and stores them into a list
-EdgeListHandle extractEdges(vector<Anchor>&         anchorList,
-                            vector< vector<BGR> >&  magnitudeMap,
-                            vector< vector<BGR> >&  directionMap,
-                            vector< vector<Anchor> >& anchorMap)
-{
-    int length = anchorList.size();
+            if (scores[c] >= CIRCLE_MIN_SCORE)
+            {
+                ranked.push_back(int(c));
+            }//if
+        }//for
 
-    //edgeList is initialized to 0 edges of 0 length.
-    //we will change these numbers after taking into account
-    //the average number of edges and average pixels per edge
-    //(once the data becomes available) in order to minimize
-    //the number of times this array is resized.
-    EdgeListHandle edgeList = initEdgeList(0, 0);
+        sort(ranked.begin(), ranked.end(), [&](int a, int b)
+        {
+            return scores[a] != scores[b] ? scores[a] > scores[b] : a < b;
+        });
 
-    for (int i = 0; i < length; i++)
-    {
-        getEdgePixels(&edgeList, anchorList[i], i, magnitudeMap, directionMap, anchorMap);
-    }//for
+        //the blurred outline of a ball gives two or three parallel edges,
+        //and so a few nearly equal circles, only the best one is kept
+        circles.clear();
+        circleHash.reset(int(ranked.size()));
+
+        for (size_t k = 0; k < ranked.size(); k++)
+        {
+            const Candidate& candidate = candidates[ranked[k]];
+
+            bool duplicate = false;
+
+            circleHash.near(candidate.cx, candidate.cy, candidate.r, nearby);
+
+            for (size_t n = 0; n < nearby.size() && !duplicate; n++)
+            {
+                const Circle& kept = circles[nearby[n]];
+
+                float tolerance = CIRCLE_MERGE_TOLERANCE*kept.r;
+
+                duplicate = hypot(candidate.cx - kept.cx, candidate.cy - kept.cy) <= tolerance &&
+                            abs(candidate.r - kept.r) <= tolerance;
+            }//for
 
-    return edgeList;
-}//getEdgeList
+            if (!duplicate)
+            {
+                Circle circle;
+
+                circle.cx    = candidate.cx;
+                circle.cy    = candidate.cy;
+                circle.r     = candidate.r;
+                circle.score = scores[ranked[k]];
 
-//once we have extracted the edges, we will apply a circular arc detection
-//algorithm
-//and then use that to get the x-y locations of balls in the image.
+                circleHash.insert(int(circles.size()), circle.cx, circle.cy, circle.r);
 
-void frameToVector(Mat& frame, vector< vector<BGR> >& output)
+                circles.push_back(circle);
+            }//if
+        }//for
+    }//scoreCircles
+
+    double originX; //the fits are relative to the center of the frame
+    double originY;
+    float  maxRadius;
+
+    const vector<LineSegment>* segments; //of the frame being detected
+    vector<Arc>         arcs;
+    vector<Candidate>   candidates;
+    vector<int>         order;         //of the arcs, longest first
+    vector<int>         lengthStarts;  //first place in order of each arc length, longest first
+    vector<int>         circleOfArc;   //candidate each arc joined
+    CircleHash          candidateHash; //of the candidates, as they are while the arcs are joined
+    vector<int>         nearby;        //candidates or circles from the hash
+    vector<int>         binOffsets;    //first bin of each candidate
+    vector<uint8_t>     covered;       //bins of the circumferences that are on edges
+    vector<float>       scores;        //of each candidate
+    vector<int>         ranked;        //candidates that score high enough, best first
+    CircleHash          circleHash;    //of the circles kept so far
+};//class CircleDetector
+
+//draws each circle in red on the output
+void drawCircles(const vector<Circle>& circles, const ImageView<BGR8>& output)
 {
-    for (int i = 0; i < frame.rows; i++)
+    for (size_t k = 0; k < circles.size(); k++)
     {
-        for (int j = 0; j < frame.cols; j++)
+        //about two points per pixel of the circumference
+        int points = max(8, int(4*CV_PI*circles[k].r));
+
+        for (int p = 0; p < points; p++)
         {
-            output[i][j].B = frame.data[frame.step[0]*i + frame.step[1]*j + 0];
-            output[i][j].G = frame.data[frame.step[0]*i + frame.step[1]*j + 1];
-            output[i][j].R = frame.data[frame.step[0]*i + frame.step[1]*j + 2];
+            double angle = 2*CV_PI*p/points;
+
+            int i = int(floor(circles[k].cy + circles[k].r*sin(angle) + 0.5));
+            int j = int(floor(circles[k].cx + circles[k].r*cos(angle) + 0.5));
+
+            if (i >= 0 && i < output.rows && j >= 0 && j < output.cols)
+            {
+                output(i, j).B = 0;
+                output(i, j).G = 0;
+                output(i, j).R = 255;
+            }//if
         }//for
     }//for
-}//frameToVector
+}//drawCircles
 
-void vectorToFrame(vector< vector<BGR> >& input, Mat& frame)
+void drawLines(const vector<Line>& lines, const ImageView<BGR8>& output)
 {
-    for (int i = 0; i < frame.rows; i++)
+    for (size_t k = 0; k < lines.size(); k++)
     {
-        for (int j = 0; j < frame.cols; j++)
+        //two points per pixel of the length
+        int points = max(2, int(2*hypot(lines[k].x2 - lines[k].x1, lines[k].y2 - lines[k].y1)));
+
+        for (int p = 0; p <= points; p++)
         {
-            frame.data[frame.step[0]*i + frame.step[1]*j + 0] = input[i][j].B;
-            frame.data[frame.step[0]*i + frame.step[1]*j + 1] = input[i][j].G;
-            frame.data[frame.step[0]*i + frame.step[1]*j + 2] = input[i][j].R;
+            float t = float(p)/points;
+
+            int i = int(floor(lines[k].y1 + t*(lines[k].y2 - lines[k].y1) + 0.5f));
+            int j = int(floor(lines[k].x1 + t*(lines[k].x2 - lines[k].x1) + 0.5f));
+
+            if (i >= 0 && i < output.rows && j >= 0 && j < output.cols)
+            {
+                output(i, j).B = 0;
+                output(i, j).G = 255;
+                output(i, j).R = 0;
+            }//if
         }//for
     }//for
-}//vectorToFrame
+}//drawLines
 
-int main(int argc, char** argv)
+//the frames are decoded, processed and shown on separate threads, by
+//PROCESSING_WORKERS workers that each have QUEUE_DEPTH frames queued
+const int             PROCESSING_WORKERS = 2;
+const int             QUEUE_DEPTH        = 2;
+const FullQueuePolicy QUEUE_POLICY       = WAIT_WHEN_FULL; //DROP_WHEN_FULL for a live camera
+
+//the whole chain of one frame. The images are kept across frames so that
+//their storage is only allocated once, every worker has its own.
+struct EDCirclesWorker
 {
-    const int   TIME_TO_WAIT_FOR_INPUT = 1; //set to 0 for infinite
-    const char  ESC_KEY_CODE           = char(27);
+    Image<Gray16>  magnitudeMap;
+    DirectionMap   directionMap;
+    Image<Anchor>  anchorMap;
+    vector<Anchor> anchorList;
+    EdgeList       edgeList;
+    vector<Line>   lines;
+    vector<Circle> circles;
+    vector<float>  empCumDist;
+
+    MagnitudeHistogram histogram;
+
+    //the gray image is smoothed in fixed point, AnchorPipeline<Gray32f> runs
+    //the floating point reference
+    AnchorPipeline<Gray8>             pipeline;
+    AnchorBuckets                     anchorBuckets;
+    EdgeLinker<EDGE_DIRECTION_BITS>   linker;
+    LineDetector                      lineDetector;
+    CircleDetector                    circleDetector;
+
+    void operator()(const Mat& input, Mat& output, string& results)
+    {
+        //grayScale, gaussianFilter, prewittOp and getAnchorMap in one pass
+        pipeline.run(matView<const BGR8>(input), magnitudeMap, directionMap, anchorMap, &histogram, &anchorList);
+
+        //the edges are linked from the strongest anchors first
+        anchorBuckets.sort(anchorList);
+
+        linker.extractEdges(anchorList, magnitudeMap, directionMap, edgeList);
+
+        getEmpCumDist(histogram, empCumDist);
+
+        lineDetector  .detect(edgeList, empCumDist, input.rows, input.cols, lines);
+        circleDetector.detect(edgeList, lineDetector.lineSegments(), input.rows, input.cols, circles);
+
+        draw(output);
+
+        for (size_t k = 0; k < lines.size(); k++)
+        {
+            appendResult(results, "line %.1f %.1f %.1f %.1f %.1f\n", lines[k].x1, lines[k].y1, lines[k].x2, lines[k].y2, lines[k].nfa);
+        }//for
+
+        for (size_t k = 0; k < circles.size(); k++)
+        {
+            appendResult(results, "circle %.2f %.2f %.2f %.3f\n", circles[k].cx, circles[k].cy, circles[k].r, circles[k].score);
+        }//for
+    }//operator()
+
+private:
+    void draw(Mat& output)
+    {
+        STAGE_TIMER("draw");
+
+        convertAnchorToBGR(anchorMap, matView<BGR8>(output));
+        drawLines  (lines  , matView<BGR8>(output));
+        drawCircles(circles, matView<BGR8>(output));
+        //createEdgeMap(outImage, magnitudeMap, directionMap);
+    }//draw
+};//struct EDCirclesWorker
+
+//times each stage on its own, on the synthetic frames of Benchmark.hpp. The
+//inputs of a stage are made by the stages before it, once per frame, and
+//the buffers are kept across calls as a worker keeps them.
+int runBenchmarks(Benchmark& benchmark)
+{
+    Image<Gray8>       grayImage;
+    Image<Gray8>       smoothImage;
+    Image<Gray16>      magnitudeMap;
+    DirectionMap       directionMap;
+    Image<Anchor>      anchorMap;
+    vector<Anchor>     anchorList;
+    vector<Anchor>     sortedList;
+    vector<float>      empCumDist;
+    EdgeList           edgeList;
+    vector<Line>       lines;
+    vector<Circle>     circles;
+    MagnitudeHistogram histogram;
+
+    GaussianRings<Gray8>            gaussianRings;
+    GradientRows<Gray8>             gradientRows;
+    MagnitudeHistograms             threadHistograms;
+    AnchorPipeline<Gray8>           pipeline;
+    AnchorBuckets                   anchorBuckets;
+    EdgeLinker<EDGE_DIRECTION_BITS> linker;
+    LineDetector                    lineDetector;
+    CircleDetector                  circleDetector;
+
+    double pixels         = 0;
+    double directionBytes = 0;
+
+    //runs the whole chain on a frame, so that every stage has its inputs
+    auto prepare = [&](const ImageView<const BGR8>& frame)
+    {
+        grayScale     (frame, grayImage);
+        gaussianFilter<Gray8>(grayImage, smoothImage, gaussianRings);
 
-    namedWindow("input" , CV_WINDOW_NORMAL);
-    namedWindow("output", CV_WINDOW_NORMAL);
+        pipeline.run(frame, magnitudeMap, directionMap, anchorMap, &histogram, &anchorList);
 
-    string       inFileName = "/home/nikola/bouncyBalls.flv";
-    VideoCapture inVideo    = VideoCapture(inFileName.c_str());
+        getEmpCumDist(histogram, empCumDist);
+        sortedList = anchorList;
 
-    Mat frame;
+        anchorBuckets.sort(sortedList);
+        linker       .extractEdges(sortedList, magnitudeMap, directionMap, edgeList);
+        lineDetector .detect(edgeList, empCumDist, frame.rows, frame.cols, lines);
 
-    while(1)
+        pixels         = double(frame.rows)*frame.cols;
+        directionBytes = double(frame.rows)*DirectionMap::packedCols(frame.cols);
+    };
+
+    benchmark.add("grayScale", [&](const ImageView<const BGR8>& frame)
+    {
+        prepare(frame);
+
+        return TimedCall([&, frame]() { grayScale(frame, grayImage); },
+                         pixels*(sizeof(BGR8) + sizeof(Gray8)));
+    });
+
+    benchmark.add("gaussianFilter", [&](const ImageView<const BGR8>& frame)
+    {
+        prepare(frame);
+
+        return TimedCall([&]() { gaussianFilter<Gray8>(grayImage, smoothImage, gaussianRings); },
+                         pixels*2*sizeof(Gray8));
+    });
+
+    benchmark.add("prewittOp", [&](const ImageView<const BGR8>& frame)
+    {
+        prepare(frame);
+
+        return TimedCall([&]() { prewittOp(ImageView<const Gray8>(smoothImage), magnitudeMap, directionMap, gradientRows); },
+                         pixels*(sizeof(Gray8) + sizeof(Gray16)) + directionBytes);
+    });
+
+    benchmark.add("getAnchorMap", [&](const ImageView<const BGR8>& frame)
+    {
+        prepare(frame);
+
+        return TimedCall([&]() { getAnchorMap(ImageView<const Gray8>(smoothImage), magnitudeMap, directionMap, anchorMap); },
+                         pixels*(sizeof(Gray16) + sizeof(Anchor)) + directionBytes);
+    });
+
+    benchmark.add("anchorPipeline", [&](const ImageView<const BGR8>& frame)
+    {
+        prepare(frame);
+
+        return TimedCall([&, frame]() { pipeline.run(frame, magnitudeMap, directionMap, anchorMap, &histogram, &anchorList); },
+                         pixels*(sizeof(BGR8) + sizeof(Gray16) + sizeof(Anchor)) + directionBytes
+                         + anchorList.size()*sizeof(Anchor));
+    });
+
+    benchmark.add("getEmpCumDist", [&](const ImageView<const BGR8>& frame)
     {
-        inVideo >> frame;
+        prepare(frame);
 
-        imshow("input" , frame);
+        return TimedCall([&]() { getEmpCumDist(ImageView<const Gray16>(magnitudeMap), threadHistograms, empCumDist); },
+                         pixels*sizeof(Gray16));
+    });
 
-        vector< vector<BGR> > inVec;
-        inVec.resize(frame.rows, vector<BGR>(frame.cols));
+    //the sort of the anchor list as the worker runs it, with the buckets kept
+    //across calls. The list is copied back before each sort, which is
+    //counted in the time.
+    benchmark.add("sortAnchorList", [&](const ImageView<const BGR8>& frame)
+    {
+        prepare(frame);
+
+        return TimedCall([&]() { sortedList = anchorList; anchorBuckets.sort(sortedList); },
+                         4.0*anchorList.size()*sizeof(Anchor));
+    });
+
+    benchmark.add("extractEdges", [&](const ImageView<const BGR8>& frame)
+    {
+        prepare(frame);
+
+        return TimedCall([&]() { linker.extractEdges(sortedList, magnitudeMap, directionMap, edgeList); },
+                         sortedList.size()*sizeof(Anchor) + edgeList.pixelCount()*(sizeof(Gray16) + sizeof(Anchor)));
+    });
+
+    benchmark.add("detectLines", [&](const ImageView<const BGR8>& frame)
+    {
+        prepare(frame);
+
+        int rows = frame.rows;
+        int cols = frame.cols;
 
-        frameToVector(frame, inVec);
+        return TimedCall([&, rows, cols]() { lineDetector.detect(edgeList, empCumDist, rows, cols, lines); },
+                         edgeList.pixelCount()*sizeof(Anchor));
+    });
 
-        grayScale(inVec);
+    benchmark.add("detectCircles", [&](const ImageView<const BGR8>& frame)
+    {
+        prepare(frame);
+
+        int rows = frame.rows;
+        int cols = frame.cols;
 
-        inVec = gaussianFilter(inVec);
+        return TimedCall([&, rows, cols]() { circleDetector.detect(edgeList, lineDetector.lineSegments(), rows, cols, circles); },
+                         edgeList.pixelCount()*sizeof(Anchor));
+    });
 
-        vector< vector<BGR> > magnitudeMap = prewittOp(inVec, MAGNITUDE);
-        vector< vector<BGR> > directionMap = prewittOp(inVec, DIRECTION);
+    return benchmark.run();
+}//runBenchmarks
 
-        vector< vector<Anchor> > anchorMap;
-        anchorMap = getAnchorMap(inVec, magnitudeMap, directionMap);
+int main(int argc, char** argv)
+{
+    //EDCircles --bench [...] times the stages instead, see Benchmark.hpp
+    Benchmark benchmark("EDCircles", argc, argv);
 
-        inVec = convertAnchorToBGR(anchorMap);
-        //inVec = createEdgeMap (inVec, magnitudeMap, directionMap);
+    if (benchmark.requested())
+    {
+        return runBenchmarks(benchmark);
+    }//if
 
-        vectorToFrame(inVec, frame);
+    //EDCircles [--headless] [--out DIR] [VIDEO ...], see FrameSinks.hpp
+    RunOptions options;
 
-        inVec.clear();
-        magnitudeMap.clear();
-        directionMap.clear();
+    if (!parseRunOptions(argc, argv, "/home/nikola/bouncyBalls.flv", options))
+    {
+        return 1;
+    }//if
 
-        imshow("output", frame);
+    vector<EDCirclesWorker>        workers(PROCESSING_WORKERS);
+    VideoPipeline<EDCirclesWorker> videoPipeline(workers, QUEUE_DEPTH, QUEUE_POLICY);
 
-        char c = cvWaitKey(TIME_TO_WAIT_FOR_INPUT);
-        if (c == ESC_KEY_CODE) break;
-    }//while
+    //the display only waits for the window events, the frames come as fast
+    //as the workers process them. Headless, the lines and the circles of
+    //every frame are printed.
+    runInputs(videoPipeline, options);
 
     return 0;
 }//main
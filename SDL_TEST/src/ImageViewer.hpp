@@ -11,6 +11,7 @@
 #include "SDL.h"
 #include "SDL_image.h"
 #include "SobelTrying.hpp"
+#include "../../common/SurfaceView.hpp"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
@@ -130,25 +131,29 @@ void display(SDL_Surface*& screen,RGBTRIPLE **rgb)
 
     /* Code to set a yellow pixel at the center of the screen */
 
-    int x, y;
-    Uint32 color;
-
     if ( SDL_LockSurface(screen) < 0 ) {
     	fprintf(stderr, "Can't lock screen: %s\n", SDL_GetError());
     	exit(-1);
     }
 
-    for (int i = 0; i < ROWS; i++)
+    //the screen is 8 bits per pixel, written in place one surface row at a time.
+    //rgb[i][j] is pixel x = i, y = j, so a surface row is column j of rgb.
+    ImageView<Uint8> pixels = surfaceView<Uint8>(screen);
+
+    int width  = ROWS < pixels.cols ? ROWS : pixels.cols;
+    int height = COLS < pixels.rows ? COLS : pixels.rows;
+
+    for (int j = 0; j < height; j++)
     {
-    	for (int j = 0; j < COLS; j++)
-    	{
-    		color = SDL_MapRGB(screen->format, rgb[i][j].rgbtRed, rgb[i][j].rgbtGreen, rgb[i][j].rgbtBlue);
-    		putpixel(screen, i, j, color);
+    	Uint8* out = pixels.row(j);
 
+    	for (int i = 0; i < width; i++)
+    	{
+    		out[i] = SDL_MapRGB(screen->format, rgb[i][j].rgbtRed, rgb[i][j].rgbtGreen, rgb[i][j].rgbtBlue);
     	}
     }
 
-    SDL_FreeSurface(screen);
+    SDL_UnlockSurface(screen);
     SDL_Flip(screen);
 
 
@@ -21,7 +21,7 @@ using namespace std;
 
 typedef unsigned short  WORD;
 typedef unsigned int   	DWORD;
-typedef long            LONG;
+typedef int             LONG;   //32 bits, as in the file, also where long is 64
 
 #pragma pack(push, 1)
 
@@ -5,16 +5,38 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
+#include <string.h>
 #include "ImageViewer.hpp"
 #include "SobelTrying.hpp"
 #include "bmp2rgb.hpp"
 
 using namespace std;
 
+//writes the gray map as a binary PGM, x = i, y = j as on the screen
+void write_pgm(FILE* file,RGBTRIPLE **gray)
+{
+	fprintf(file, "P5\n%d %d\n255\n", ROWS, COLS);
 
+	for (int j = 0; j < COLS; j++)
+	{
+		for (int i = 0; i < ROWS; i++)
+		{
+			fputc(gray[i][j].rgbtRed, file);
+		}
+	}
+}
 
+//usage: main [--headless] image.bmp
+//headless, no SDL window is opened and the gray image goes to stdout as a
+//PGM, otherwise it is shown until the window is closed
 int main( int argc, char* argv[] )
 {
+	bool headless = argc > 2 && strcmp(argv[1], "--headless") == 0;
+
+	if (headless)
+	{
+		argv++;
+	}
 
 	bool quit = false;
 	SDL_Surface *screen;
@@ -44,6 +66,12 @@ int main( int argc, char* argv[] )
 	object_map = ConvertTo2D(object_buf);
 	object_map = ToGrayScale(object_map);
 //
+	if (headless)
+	{
+		write_pgm(stdout, object_map);
+		return 0;
+	}
+
 	screen = init();
 
 //	delta_frame = DeltaFrameGeneration(background_map,object_map);
@@ -63,13 +91,11 @@ int main( int argc, char* argv[] )
 
 
 
-	while(quit == false)
+	//sleeps until an event comes instead of spinning on SDL_PollEvent
+	while(quit == false && SDL_WaitEvent( &event ))
 	{
-		while( SDL_PollEvent( &event ) )
-		{
-			if( event.type == SDL_QUIT )
-				quit = true;
-		}
+		if( event.type == SDL_QUIT )
+			quit = true;
 	}
 
 
@@ -3,12 +3,47 @@
 #include <malloc.h>
 #include "SobelTrying.hpp"
 #include "bmp2rgb.hpp"
+#include "../../common/Benchmark.hpp"
 
 using namespace std;
 
+//times LoadBitmapFile on the synthetic frames of Benchmark.hpp, each written
+//to a BMP first. The file is read from the page cache, so this is the cost
+//of parsing, swapping and copying the pixels.
+int runBenchmarks(Benchmark& benchmark)
+{
+	char fileName[] = "LoadBitmapFile_benchmark.bmp";
+
+	benchmark.add("LoadBitmapFile", [&](const ImageView<const BGR8>& frame)
+	{
+		writeBmp(fileName, frame);
+
+		double pixels = double(frame.rows)*frame.cols;
+
+		return TimedCall([&]()
+		{
+			BITMAPINFOHEADER bitmapInfoHeader;
+
+			free(LoadBitmapFile(fileName, &bitmapInfoHeader));
+		}, pixels*(3 + sizeof(RGBTRIPLE)));
+	});
 
+	int result = benchmark.run();
+
+	remove(fileName);
+
+	return result;
+}
+
+//usage: main image.bmp, or main --bench [...], see Benchmark.hpp
 int main(int argc, char *argv[])
 {
+	Benchmark benchmark("SobelTest", argc, argv);
+
+	if (benchmark.requested())
+	{
+		return runBenchmarks(benchmark);
+	}
 
 
 	BITMAPINFOHEADER bitmapInfoHeader;
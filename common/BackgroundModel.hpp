@@ -0,0 +1,437 @@
+//BackgroundModel.hpp
+//
+//A background that follows the scene, for motion detection on a stream of
+//gray frames.
+//
+//Every pixel keeps its own estimate of the background, in a plane that is
+//allocated once, and each frame is compared with it and then folded into it
+//in the same pass: update() writes |frame - background| for every pixel and
+//moves the background a step toward the frame, so slow changes such as the
+//light drifting over the day are learnt instead of showing up as motion.
+//
+//  BACKGROUND_STATIC   the first frame is kept as it is, the frames are only
+//                      compared with it
+//  BACKGROUND_AVERAGE  an exponential running average,
+//                      background += (frame - background)/2^shift, kept in a
+//                      uint16_t with 8 fractional bits so that small steps
+//                      are not rounded away
+//  BACKGROUND_MEDIAN   an approximate running median in a Gray8: the
+//                      background moves step gray levels up or down toward
+//                      the frame, so it settles on the level that is above
+//                      the frame as often as it is below it, and a moving
+//                      object that covers a pixel now and then does not pull
+//                      it
+//
+//The averages are stepped with saturating unsigned arithmetic, up by
+//(frame - background) >> shift and down by (background - frame) >> shift
+//with one of them 0, so a vector instruction handles 8, 16 or 32 pixels of
+//the average and 16, 32 or 64 of the median, and the vector kernels give
+//bit-identical results to the scalar reference.
+
+#ifndef BACKGROUNDMODEL_HPP_
+#define BACKGROUNDMODEL_HPP_
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include "Image.hpp"
+#include "PixelFormats.hpp"
+#include "Simd.hpp"
+#include "ThreadPool.hpp"
+
+enum BackgroundMethod
+{
+    BACKGROUND_STATIC,
+    BACKGROUND_AVERAGE,
+    BACKGROUND_MEDIAN
+};//enum BackgroundMethod
+
+//fractional bits of the running average
+const int BACKGROUND_FRACTION_BITS = 8;
+
+//*****************************************************************************
+//scalar reference
+//*****************************************************************************
+
+//columns [begin, end) of a row of the running average
+inline void backgroundAverageColumns(const Gray8* in, uint16_t* model, Gray8* delta,
+                                     int begin, int end, int shift)
+{
+    const int ROUND = 1 << (BACKGROUND_FRACTION_BITS - 1);
+
+    for (int j = begin; j < end; j++)
+    {
+        int value      = in[j] << BACKGROUND_FRACTION_BITS;
+        int background = model[j];
+        int level      = (background + ROUND) >> BACKGROUND_FRACTION_BITS;
+
+        delta[j] = Gray8(std::abs(in[j] - level));
+
+        if (value > background)
+        {
+            background += (value - background) >> shift;
+        }//if
+        else
+        {
+            background -= (background - value) >> shift;
+        }//else
+
+        model[j] = uint16_t(background);
+    }//for
+}//backgroundAverageColumns
+
+//columns [begin, end) of a row of the running median, with step 0 the
+//background stays as it is
+inline void backgroundMedianColumns(const Gray8* in, Gray8* model, Gray8* delta,
+                                    int begin, int end, int step)
+{
+    for (int j = begin; j < end; j++)
+    {
+        int value      = in[j];
+        int background = model[j];
+
+        delta[j] = Gray8(std::abs(value - background));
+
+        if (value > background)
+        {
+            background += std::min(value - background, step);
+        }//if
+        else
+        {
+            background -= std::min(background - value, step);
+        }//else
+
+        model[j] = Gray8(background);
+    }//for
+}//backgroundMedianColumns
+
+//*****************************************************************************
+//vector kernels, each returns the column it stopped at
+//*****************************************************************************
+
+#if SIMD_X86
+
+SIMD_TARGET_SSE41
+inline int backgroundAverageSSE41(const Gray8* in, uint16_t* model, Gray8* delta, int cols, int shift)
+{
+    const __m128i round = _mm_set1_epi16(1 << (BACKGROUND_FRACTION_BITS - 1));
+    const __m128i count = _mm_cvtsi32_si128(shift);
+
+    int j = 0;
+
+    for (; j + 8 <= cols; j += 8)
+    {
+        __m128i pixels     = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(in + j)));
+        __m128i background = _mm_loadu_si128((const __m128i*)(model + j));
+        __m128i value      = _mm_slli_epi16(pixels, BACKGROUND_FRACTION_BITS);
+        __m128i level      = _mm_srli_epi16(_mm_add_epi16(background, round), BACKGROUND_FRACTION_BITS);
+
+        __m128i difference = _mm_or_si128(_mm_subs_epu16(pixels, level), _mm_subs_epu16(level, pixels));
+
+        _mm_storel_epi64((__m128i*)(delta + j), _mm_packus_epi16(difference, difference));
+
+        __m128i up   = _mm_srl_epi16(_mm_subs_epu16(value, background), count);
+        __m128i down = _mm_srl_epi16(_mm_subs_epu16(background, value), count);
+
+        _mm_storeu_si128((__m128i*)(model + j), _mm_sub_epi16(_mm_add_epi16(background, up), down));
+    }//for
+
+    return j;
+}//backgroundAverageSSE41
+
+SIMD_TARGET_AVX2
+inline int backgroundAverageAVX2(const Gray8* in, uint16_t* model, Gray8* delta, int cols, int shift)
+{
+    const __m256i round = _mm256_set1_epi16(1 << (BACKGROUND_FRACTION_BITS - 1));
+    const __m128i count = _mm_cvtsi32_si128(shift);
+
+    int j = 0;
+
+    for (; j + 16 <= cols; j += 16)
+    {
+        __m256i pixels     = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(in + j)));
+        __m256i background = _mm256_loadu_si256((const __m256i*)(model + j));
+        __m256i value      = _mm256_slli_epi16(pixels, BACKGROUND_FRACTION_BITS);
+        __m256i level      = _mm256_srli_epi16(_mm256_add_epi16(background, round), BACKGROUND_FRACTION_BITS);
+
+        __m256i difference = _mm256_or_si256(_mm256_subs_epu16(pixels, level), _mm256_subs_epu16(level, pixels));
+
+        _mm_storeu_si128((__m128i*)(delta + j), _mm_packus_epi16(_mm256_castsi256_si128(difference),
+                                                                 _mm256_extracti128_si256(difference, 1)));
+
+        __m256i up   = _mm256_srl_epi16(_mm256_subs_epu16(value, background), count);
+        __m256i down = _mm256_srl_epi16(_mm256_subs_epu16(background, value), count);
+
+        _mm256_storeu_si256((__m256i*)(model + j), _mm256_sub_epi16(_mm256_add_epi16(background, up), down));
+    }//for
+
+    return j;
+}//backgroundAverageAVX2
+
+SIMD_TARGET_AVX512
+inline int backgroundAverageAVX512(const Gray8* in, uint16_t* model, Gray8* delta, int cols, int shift)
+{
+    const __m512i round = _mm512_set1_epi16(1 << (BACKGROUND_FRACTION_BITS - 1));
+    const __m128i count = _mm_cvtsi32_si128(shift);
+
+    int j = 0;
+
+    for (; j + 32 <= cols; j += 32)
+    {
+        __m512i pixels     = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(in + j)));
+        __m512i background = _mm512_loadu_si512((const void*)(model + j));
+        __m512i value      = _mm512_slli_epi16(pixels, BACKGROUND_FRACTION_BITS);
+        __m512i level      = _mm512_srli_epi16(_mm512_add_epi16(background, round), BACKGROUND_FRACTION_BITS);
+
+        __m512i difference = _mm512_or_si512(_mm512_subs_epu16(pixels, level), _mm512_subs_epu16(level, pixels));
+
+        _mm256_storeu_si256((__m256i*)(delta + j), _mm512_maskz_cvtepi16_epi8(__mmask32(~0u), difference));
+
+        __m512i up   = _mm512_srl_epi16(_mm512_subs_epu16(value, background), count);
+        __m512i down = _mm512_srl_epi16(_mm512_subs_epu16(background, value), count);
+
+        _mm512_storeu_si512((void*)(model + j), _mm512_sub_epi16(_mm512_add_epi16(background, up), down));
+    }//for
+
+    return j;
+}//backgroundAverageAVX512
+
+SIMD_TARGET_SSE41
+inline int backgroundMedianSSE41(const Gray8* in, Gray8* model, Gray8* delta, int cols, int step)
+{
+    const __m128i steps = _mm_set1_epi8(char(step));
+
+    int j = 0;
+
+    for (; j + 16 <= cols; j += 16)
+    {
+        __m128i value      = _mm_loadu_si128((const __m128i*)(in    + j));
+        __m128i background = _mm_loadu_si128((const __m128i*)(model + j));
+        __m128i above      = _mm_subs_epu8(value, background);
+        __m128i below      = _mm_subs_epu8(background, value);
+
+        _mm_storeu_si128((__m128i*)(delta + j), _mm_or_si128(above, below));
+
+        background = _mm_adds_epu8(background, _mm_min_epu8(above, steps));
+        background = _mm_subs_epu8(background, _mm_min_epu8(below, steps));
+
+        _mm_storeu_si128((__m128i*)(model + j), background);
+    }//for
+
+    return j;
+}//backgroundMedianSSE41
+
+SIMD_TARGET_AVX2
+inline int backgroundMedianAVX2(const Gray8* in, Gray8* model, Gray8* delta, int cols, int step)
+{
+    const __m256i steps = _mm256_set1_epi8(char(step));
+
+    int j = 0;
+
+    for (; j + 32 <= cols; j += 32)
+    {
+        __m256i value      = _mm256_loadu_si256((const __m256i*)(in    + j));
+        __m256i background = _mm256_loadu_si256((const __m256i*)(model + j));
+        __m256i above      = _mm256_subs_epu8(value, background);
+        __m256i below      = _mm256_subs_epu8(background, value);
+
+        _mm256_storeu_si256((__m256i*)(delta + j), _mm256_or_si256(above, below));
+
+        background = _mm256_adds_epu8(background, _mm256_min_epu8(above, steps));
+        background = _mm256_subs_epu8(background, _mm256_min_epu8(below, steps));
+
+        _mm256_storeu_si256((__m256i*)(model + j), background);
+    }//for
+
+    return j;
+}//backgroundMedianAVX2
+
+SIMD_TARGET_AVX512
+inline int backgroundMedianAVX512(const Gray8* in, Gray8* model, Gray8* delta, int cols, int step)
+{
+    const __m512i steps = _mm512_set1_epi8(char(step));
+
+    int j = 0;
+
+    for (; j + 64 <= cols; j += 64)
+    {
+        __m512i value      = _mm512_loadu_si512((const void*)(in    + j));
+        __m512i background = _mm512_loadu_si512((const void*)(model + j));
+        __m512i above      = _mm512_subs_epu8(value, background);
+        __m512i below      = _mm512_subs_epu8(background, value);
+
+        _mm512_storeu_si512((void*)(delta + j), _mm512_or_si512(above, below));
+
+        background = _mm512_adds_epu8(background, _mm512_min_epu8(above, steps));
+        background = _mm512_subs_epu8(background, _mm512_min_epu8(below, steps));
+
+        _mm512_storeu_si512((void*)(model + j), background);
+    }//for
+
+    return j;
+}//backgroundMedianAVX512
+
+#endif
+
+//*****************************************************************************
+//rows
+//*****************************************************************************
+
+inline void backgroundAverageRow(const Gray8* in, uint16_t* model, Gray8* delta, int cols,
+                                 int shift, SimdLevel level = simdLevel())
+{
+    int j = 0;
+
+#if SIMD_X86
+    switch (level)
+    {
+    case SIMD_AVX512: j = backgroundAverageAVX512(in, model, delta, cols, shift); break;
+    case SIMD_AVX2:   j = backgroundAverageAVX2  (in, model, delta, cols, shift); break;
+    case SIMD_SSE41:  j = backgroundAverageSSE41 (in, model, delta, cols, shift); break;
+    default:          break;
+    }//switch
+#endif
+
+    backgroundAverageColumns(in, model, delta, j, cols, shift);
+}//backgroundAverageRow
+
+inline void backgroundMedianRow(const Gray8* in, Gray8* model, Gray8* delta, int cols,
+                                int step, SimdLevel level = simdLevel())
+{
+    int j = 0;
+
+#if SIMD_X86
+    switch (level)
+    {
+    case SIMD_AVX512: j = backgroundMedianAVX512(in, model, delta, cols, step); break;
+    case SIMD_AVX2:   j = backgroundMedianAVX2  (in, model, delta, cols, step); break;
+    case SIMD_SSE41:  j = backgroundMedianSSE41 (in, model, delta, cols, step); break;
+    default:          break;
+    }//switch
+#endif
+
+    backgroundMedianColumns(in, model, delta, j, cols, step);
+}//backgroundMedianRow
+
+//*****************************************************************************
+//whole frames
+//*****************************************************************************
+
+class BackgroundModel
+{
+public:
+    //the average moves 1/2^averageShift of the way to each frame, the median
+    //medianStep gray levels
+    explicit BackgroundModel(BackgroundMethod method = BACKGROUND_AVERAGE,
+                             int averageShift = 5, int medianStep = 1)
+        : method(method), averageShift(averageShift), medianStep(medianStep)
+    {
+        assert(averageShift >= 0 && averageShift <= 16);
+        assert(medianStep   >= 0 && medianStep   <= 255);
+    }//BackgroundModel
+
+    bool empty() const
+    {
+        return method == BACKGROUND_AVERAGE ? average.empty() : median.empty();
+    }//empty
+
+    //starts again from a frame of the background alone. The plane keeps its
+    //storage when the frames stay the same size.
+    void reset(const ImageView<const Gray8>& frame)
+    {
+        if (method == BACKGROUND_AVERAGE)
+        {
+            average.create(frame.rows, frame.cols);
+
+            for (int i = 0; i < frame.rows; i++)
+            {
+                const Gray8* in  = frame.row(i);
+                uint16_t*    out = average.row(i);
+
+                for (int j = 0; j < frame.cols; j++)
+                {
+                    out[j] = uint16_t(in[j] << BACKGROUND_FRACTION_BITS);
+                }//for
+            }//for
+        }//if
+        else
+        {
+            median.copyFrom(frame);
+        }//else
+    }//reset
+
+    //delta(i, j) = |frame(i, j) - background(i, j)|, against the background
+    //as it was before the frame, which is then folded into the background.
+    //The first frame after construction only starts the model, and a frame
+    //of another size starts it again, with a delta of 0. Nothing is
+    //allocated once the delta is the size of the frames.
+    void update(const ImageView<const Gray8>& frame, Image<Gray8>& delta, SimdLevel level = simdLevel())
+    {
+        delta.create(frame.rows, frame.cols);
+
+        if (empty() || !(method == BACKGROUND_AVERAGE ? average.sameSize(frame) : median.sameSize(frame)))
+        {
+            reset(frame);
+        }//if
+
+        int cols = frame.cols;
+
+        parallelForRows(0, frame.rows, 0, [&](int begin, int end)
+        {
+            for (int i = begin; i < end; i++)
+            {
+                switch (method)
+                {
+                case BACKGROUND_AVERAGE:
+                    backgroundAverageRow(frame.row(i), average.row(i), delta.row(i), cols, averageShift, level);
+                    break;
+
+                case BACKGROUND_MEDIAN:
+                    backgroundMedianRow(frame.row(i), median.row(i), delta.row(i), cols, medianStep, level);
+                    break;
+
+                default:
+                    backgroundMedianRow(frame.row(i), median.row(i), delta.row(i), cols, 0, level);
+                    break;
+                }//switch
+            }//for
+        });
+    }//update
+
+    //the background as gray levels
+    void background(Image<Gray8>& out) const
+    {
+        if (method != BACKGROUND_AVERAGE)
+        {
+            out.copyFrom(median);
+
+            return;
+        }//if
+
+        const int ROUND = 1 << (BACKGROUND_FRACTION_BITS - 1);
+
+        out.create(average.rows, average.cols);
+
+        for (int i = 0; i < average.rows; i++)
+        {
+            const uint16_t* in  = average.row(i);
+            Gray8*          row = out.row(i);
+
+            for (int j = 0; j < average.cols; j++)
+            {
+                row[j] = Gray8((in[j] + ROUND) >> BACKGROUND_FRACTION_BITS);
+            }//for
+        }//for
+    }//background
+
+private:
+    BackgroundMethod method;
+    int              averageShift;
+    int              medianStep;
+
+    Image<uint16_t>  average; //BACKGROUND_AVERAGE, with BACKGROUND_FRACTION_BITS
+    Image<Gray8>     median;  //BACKGROUND_MEDIAN and BACKGROUND_STATIC
+};//class BackgroundModel
+
+#endif /* BACKGROUNDMODEL_HPP_ */
@@ -0,0 +1,788 @@
+//Benchmark.hpp
+//
+//Times the kernels of a program on synthetic frames.
+//
+//A program that includes this header runs its benchmarks instead of its
+//usual work when it is given --bench:
+//
+//    program --bench [--json FILE] [--baseline FILE] [--tolerance X]
+//                    [--sizes 480p,1080p,4k] [--kernels NAME,...] [--min-time S]
+//
+//Every kernel the program adds is run on every frame size (854x480,
+//1920x1080 and 3840x2160) and every scene: "balls", a court with bouncing
+//balls drawn procedurally, and "noise", uniform noise, which is the worst
+//case for the edge stages. The frames are the same on every run and every
+//machine, so the results of two runs can be compared.
+//
+//A kernel is set up once per frame (the inputs it needs are computed, and
+//it is called once, so that its buffers have grown), and then called until
+//--min-time has passed, at least 3 times. The median and the fastest call
+//are reported in ns per pixel, the median also in GB/s of the bytes the
+//kernel has to read and write, which is a lower bound of its traffic. In a
+//build that counts them, the heap allocations of the first call and of an
+//average later call are reported too, so that a stage which should not
+//allocate once it is warm can be seen to.
+//
+//The results go to stdout, or to --json FILE, as JSON with one result per
+//line, and as a table to stderr. With --baseline the medians are compared to
+//those of a stored run, and a kernel that is more than --tolerance (0.10)
+//slower is reported as a regression, which makes the program return 1.
+//
+//The allocations are only counted when the program is built with
+//-DBENCHMARK_COUNT_ALLOCATIONS, which is meant for a separate benchmark
+//build: the header then wraps malloc, calloc and realloc with glibc, and
+//operator new elsewhere (C++ allocations only), so every allocation of the
+//program, on any thread, adds to one shared counter, and the header has to
+//be included in only one translation unit. Without it the allocator is left
+//alone, and the allocations are reported as null in the JSON and "-" in the
+//table.
+
+#ifndef BENCHMARK_HPP_
+#define BENCHMARK_HPP_
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <new>
+#include "Image.hpp"
+#include "PixelFormats.hpp"
+
+//*****************************************************************************
+//allocation count
+//*****************************************************************************
+
+#ifdef BENCHMARK_COUNT_ALLOCATIONS
+const bool BENCHMARK_COUNTS_ALLOCATIONS = true;
+#else
+const bool BENCHMARK_COUNTS_ALLOCATIONS = false;
+#endif
+
+//heap allocations made by the program so far, always 0 unless
+//BENCHMARK_COUNTS_ALLOCATIONS
+inline std::atomic<long>& allocationCounter()
+{
+    static std::atomic<long> counter(0);
+
+    return counter;
+}//allocationCounter
+
+inline long allocationCount()
+{
+    return allocationCounter().load(std::memory_order_relaxed);
+}//allocationCount
+
+#ifdef BENCHMARK_COUNT_ALLOCATIONS
+#if defined(__GLIBC__)
+
+extern "C"
+{
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* block, size_t size);
+
+void* malloc(size_t size)
+{
+    allocationCounter().fetch_add(1, std::memory_order_relaxed);
+
+    return __libc_malloc(size);
+}//malloc
+
+void* calloc(size_t count, size_t size)
+{
+    allocationCounter().fetch_add(1, std::memory_order_relaxed);
+
+    return __libc_calloc(count, size);
+}//calloc
+
+void* realloc(void* block, size_t size)
+{
+    allocationCounter().fetch_add(1, std::memory_order_relaxed);
+
+    return __libc_realloc(block, size);
+}//realloc
+}//extern "C"
+
+#else
+
+void* operator new(std::size_t size)
+{
+    allocationCounter().fetch_add(1, std::memory_order_relaxed);
+
+    void* block = std::malloc(size != 0 ? size : 1);
+
+    if (block == NULL)
+    {
+        throw std::bad_alloc();
+    }//if
+
+    return block;
+}//operator new
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}//operator new[]
+
+void operator delete(void* block) noexcept
+{
+    std::free(block);
+}//operator delete
+
+void operator delete[](void* block) noexcept
+{
+    std::free(block);
+}//operator delete[]
+
+#endif
+#endif /* BENCHMARK_COUNT_ALLOCATIONS */
+
+//*****************************************************************************
+//synthetic frames
+//*****************************************************************************
+
+struct FrameSize
+{
+    const char* name;
+    int         rows;
+    int         cols;
+};//struct FrameSize
+
+const FrameSize BENCHMARK_SIZES[] =
+{
+    {"480p" ,  480,  854},
+    {"1080p", 1080, 1920},
+    {"4k"   , 2160, 3840}
+};
+
+const int BENCHMARK_SIZE_COUNT = sizeof(BENCHMARK_SIZES)/sizeof(BENCHMARK_SIZES[0]);
+
+enum BenchmarkScene
+{
+    BALLS_SCENE, //a court with bouncing balls
+    NOISE_SCENE  //uniform noise in every channel
+};//enum BenchmarkScene
+
+const char* const BENCHMARK_SCENE_NAMES[] = {"balls", "noise"};
+
+const int BENCHMARK_SCENE_COUNT = 2;
+
+//a hash of a few integers that is the same everywhere, so the frames do not
+//depend on rand() or on the order the pixels are drawn in
+inline uint32_t frameHash(uint32_t a, uint32_t b = 0, uint32_t c = 0)
+{
+    uint32_t h = a*0x9E3779B1u ^ (b + 0x7F4A7C15u)*0x85EBCA77u ^ (c + 0x165667B1u)*0xC2B2AE3Du;
+
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    h *= 0x297A2D39u;
+    h ^= h >> 15;
+
+    return h;
+}//frameHash
+
+//0..1
+inline float frameRandom(uint32_t a, uint32_t b = 0, uint32_t c = 0)
+{
+    return float(frameHash(a, b, c) >> 8)/float(1 << 24);
+}//frameRandom
+
+//a coordinate that moves at a constant speed and bounces between 0 and
+//length
+inline float bounce(float position, float length)
+{
+    float period = 2*length;
+    float p      = std::fmod(position, period);
+
+    if (p < 0)
+    {
+        p += period;
+    }//if
+
+    return p <= length ? p : period - p;
+}//bounce
+
+inline uint8_t clampChannel(float value)
+{
+    return uint8_t(std::min(std::max(value, 0.0f), 255.0f));
+}//clampChannel
+
+//draws frame t of a scene into frame, which has the size it is to be drawn
+//at. The balls of frame t + 1 have moved a little from frame t.
+inline void syntheticFrame(BenchmarkScene scene, int t, const ImageView<BGR8>& frame)
+{
+    const int BALL_COUNT = 60;
+
+    int rows = frame.rows;
+    int cols = frame.cols;
+
+    if (scene == NOISE_SCENE)
+    {
+        for (int i = 0; i < rows; i++)
+        {
+            BGR8* out = frame.row(i);
+
+            for (int j = 0; j < cols; j++)
+            {
+                uint32_t h = frameHash(uint32_t(i), uint32_t(j), uint32_t(t));
+
+                out[j].B = uint8_t(h);
+                out[j].G = uint8_t(h >> 8);
+                out[j].R = uint8_t(h >> 16);
+            }//for
+        }//for
+
+        return;
+    }//if
+
+    //a green court that gets lighter towards the bottom, with white lines
+    //at fixed parts of the frame and a little sensor noise
+    for (int i = 0; i < rows; i++)
+    {
+        BGR8* out   = frame.row(i);
+        float shade = 60 + 80*float(i)/rows;
+
+        bool lineRow = std::abs(i - rows/4) < std::max(rows/200, 1) || std::abs(i - 3*rows/4) < std::max(rows/200, 1);
+
+        for (int j = 0; j < cols; j++)
+        {
+            bool  line  = lineRow || std::abs(j - cols/2) < std::max(cols/300, 1);
+            float noise = 8*frameRandom(uint32_t(i), uint32_t(j), uint32_t(t)) - 4;
+
+            if (line)
+            {
+                out[j].B = clampChannel(230 + noise);
+                out[j].G = clampChannel(235 + noise);
+                out[j].R = clampChannel(235 + noise);
+            }//if
+            else
+            {
+                out[j].B = clampChannel(0.35f*shade + noise);
+                out[j].G = clampChannel(shade       + noise);
+                out[j].R = clampChannel(0.45f*shade + noise);
+            }//else
+        }//for
+    }//for
+
+    //shaded balls, lit from the top left, moving in straight lines and
+    //bouncing off the borders
+    float unit = float(std::min(rows, cols));
+
+    for (int k = 0; k < BALL_COUNT; k++)
+    {
+        float r  = unit*(0.015f + 0.035f*frameRandom(k, 1));
+        float vx = unit*(0.02f*frameRandom(k, 2) - 0.01f);
+        float vy = unit*(0.02f*frameRandom(k, 3) - 0.01f);
+        float cx = r + bounce(frameRandom(k, 4)*cols + vx*t, cols - 2*r);
+        float cy = r + bounce(frameRandom(k, 5)*rows + vy*t, rows - 2*r);
+
+        float B = 255*frameRandom(k, 6);
+        float G = 255*frameRandom(k, 7);
+        float R = 255*frameRandom(k, 8);
+
+        int top    = std::max(int(cy - r), 0);
+        int bottom = std::min(int(cy + r) + 1, rows);
+        int left   = std::max(int(cx - r), 0);
+        int right  = std::min(int(cx + r) + 1, cols);
+
+        for (int i = top; i < bottom; i++)
+        {
+            BGR8* out = frame.row(i);
+
+            for (int j = left; j < right; j++)
+            {
+                float dx = (j - cx)/r;
+                float dy = (i - cy)/r;
+
+                if (dx*dx + dy*dy <= 1)
+                {
+                    float light = 1.1f - 0.3f*(dx + dy);
+
+                    out[j].B = clampChannel(B*light);
+                    out[j].G = clampChannel(G*light);
+                    out[j].R = clampChannel(R*light);
+                }//if
+            }//for
+        }//for
+    }//for
+}//syntheticFrame
+
+//writes a frame as an uncompressed 24 bit BMP, bottom row first, false if
+//the file cannot be written
+inline bool writeBmp(const char* fileName, const ImageView<const BGR8>& frame)
+{
+    int rowBytes = (3*frame.cols + 3) & ~3;
+    int dataSize = rowBytes*frame.rows;
+
+    uint8_t header[54] = {'B', 'M'};
+
+    //the little endian fields of the file and info headers
+    struct Field
+    {
+        int      offset;
+        int      bytes;
+        uint32_t value;
+    };
+
+    const Field fields[] =
+    {
+        { 2, 4, uint32_t(54 + dataSize)}, //file size
+        {10, 4, 54},                      //offset of the pixels
+        {14, 4, 40},                      //info header size
+        {18, 4, uint32_t(frame.cols)},
+        {22, 4, uint32_t(frame.rows)},
+        {26, 2, 1},                       //planes
+        {28, 2, 24},                      //bits per pixel
+        {34, 4, uint32_t(dataSize)}
+    };
+
+    for (size_t k = 0; k < sizeof(fields)/sizeof(fields[0]); k++)
+    {
+        for (int b = 0; b < fields[k].bytes; b++)
+        {
+            header[fields[k].offset + b] = uint8_t(fields[k].value >> (8*b));
+        }//for
+    }//for
+
+    FILE* file = fopen(fileName, "wb");
+
+    if (file == NULL)
+    {
+        return false;
+    }//if
+
+    std::vector<uint8_t> row(rowBytes, 0);
+
+    bool written = fwrite(header, sizeof(header), 1, file) == 1;
+
+    for (int i = frame.rows - 1; i >= 0 && written; i--)
+    {
+        memcpy(row.data(), frame.row(i), 3*frame.cols);
+
+        written = fwrite(row.data(), rowBytes, 1, file) == 1;
+    }//for
+
+    return fclose(file) == 0 && written;
+}//writeBmp
+
+//*****************************************************************************
+//benchmark
+//*****************************************************************************
+
+//a kernel that is set up on a frame: run() is what is timed, bytes is what
+//one call has to read and write at least, 0 if that is not known
+struct TimedCall
+{
+    std::function<void()> run;
+    double                bytes;
+
+    TimedCall(const std::function<void()>& run, double bytes) : run(run), bytes(bytes) {}
+};//struct TimedCall
+
+struct BenchmarkResult
+{
+    std::string kernel;
+    std::string size;
+    std::string scene;
+    int         rows;
+    int         cols;
+    int         calls;
+    double      medianNs;    //per pixel
+    double      fastestNs;   //per pixel
+    double      gbPerSecond; //at the median, 0 if the bytes are not known
+    long        firstCallAllocations; //-1 if the allocations are not counted
+    double      allocations;          //per call after the first, -1 if not counted
+};//struct BenchmarkResult
+
+class Benchmark
+{
+public:
+    typedef std::function<TimedCall(const ImageView<const BGR8>& frame)> Setup;
+
+    //reads the benchmark options, requested() tells whether --bench was given
+    Benchmark(const char* program, int argc, char** argv)
+        : program(program), benchmarking(false), tolerance(0.10), minTime(0.25)
+    {
+        for (int k = 1; k < argc; k++)
+        {
+            std::string arg  = argv[k];
+            bool        more = k + 1 < argc;
+
+            if (arg == "--bench")
+            {
+                benchmarking = true;
+            }//if
+            else if (arg == "--json" && more)
+            {
+                jsonFile = argv[++k];
+            }//else if
+            else if (arg == "--baseline" && more)
+            {
+                baselineFile = argv[++k];
+            }//else if
+            else if (arg == "--tolerance" && more)
+            {
+                tolerance = atof(argv[++k]);
+            }//else if
+            else if (arg == "--min-time" && more)
+            {
+                minTime = atof(argv[++k]);
+            }//else if
+            else if (arg == "--sizes" && more)
+            {
+                sizes = split(argv[++k]);
+            }//else if
+            else if (arg == "--kernels" && more)
+            {
+                kernelNames = split(argv[++k]);
+            }//else if
+        }//for
+    }//Benchmark
+
+    bool requested() const
+    {
+        return benchmarking;
+    }//requested
+
+    //setup(frame) prepares the inputs of the kernel from a frame, and
+    //returns the call that is timed. A kernel named "stage/variant" is also
+    //selected by --kernels stage.
+    void add(const std::string& kernel, const Setup& setup)
+    {
+        if (selected(kernel))
+        {
+            kernels.push_back(kernel);
+            setups .push_back(setup);
+        }//if
+    }//add
+
+    //runs every kernel on every size and scene, 1 if one of them regressed
+    //against the baseline, 2 if a file could not be read or written
+    int run()
+    {
+        std::vector<BenchmarkResult> results;
+
+        Image<BGR8> frame;
+
+        fprintf(stderr, "%-24s %-6s %-6s %12s %12s %9s %8s %8s\n",
+                "kernel", "size", "scene", "ns/pixel", "fastest", "GB/s", "allocs", "first");
+
+        for (int s = 0; s < BENCHMARK_SIZE_COUNT; s++)
+        {
+            const FrameSize& size = BENCHMARK_SIZES[s];
+
+            if (!sizes.empty() && std::find(sizes.begin(), sizes.end(), size.name) == sizes.end())
+            {
+                continue;
+            }//if
+
+            for (int scene = 0; scene < BENCHMARK_SCENE_COUNT; scene++)
+            {
+                frame.create(size.rows, size.cols);
+                syntheticFrame(BenchmarkScene(scene), 0, frame);
+
+                for (size_t k = 0; k < kernels.size(); k++)
+                {
+                    TimedCall call = setups[k](frame);
+
+                    BenchmarkResult result;
+
+                    result.kernel = kernels[k];
+                    result.size   = size.name;
+                    result.scene  = BENCHMARK_SCENE_NAMES[scene];
+                    result.rows   = size.rows;
+                    result.cols   = size.cols;
+
+                    measure(call, result);
+
+                    fprintf(stderr, "%-24s %-6s %-6s %12.3f %12.3f %9.2f %8s %8s\n",
+                            result.kernel.c_str(), result.size.c_str(), result.scene.c_str(),
+                            result.medianNs, result.fastestNs, result.gbPerSecond,
+                            formatCount(result.allocations, "%.2f", "-").c_str(),
+                            formatCount(double(result.firstCallAllocations), "%.0f", "-").c_str());
+
+                    results.push_back(result);
+                }//for
+            }//for
+        }//for
+
+        if (!writeJson(results))
+        {
+            return 2;
+        }//if
+
+        if (!baselineFile.empty())
+        {
+            return compareToBaseline(results);
+        }//if
+
+        return 0;
+    }//run
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    static std::vector<std::string> split(const std::string& list)
+    {
+        std::vector<std::string> names;
+
+        for (size_t begin = 0; begin <= list.size(); )
+        {
+            size_t end = list.find(',', begin);
+
+            if (end == std::string::npos)
+            {
+                end = list.size();
+            }//if
+
+            if (end > begin)
+            {
+                names.push_back(list.substr(begin, end - begin));
+            }//if
+
+            begin = end + 1;
+        }//for
+
+        return names;
+    }//split
+
+    bool selected(const std::string& kernel) const
+    {
+        if (kernelNames.empty())
+        {
+            return true;
+        }//if
+
+        for (size_t k = 0; k < kernelNames.size(); k++)
+        {
+            const std::string& name = kernelNames[k];
+
+            if (kernel == name || kernel.compare(0, name.size() + 1, name + "/") == 0)
+            {
+                return true;
+            }//if
+        }//for
+
+        return false;
+    }//selected
+
+    void measure(const TimedCall& call, BenchmarkResult& result) const
+    {
+        const int MIN_CALLS = 3;
+        const int MAX_CALLS = 10000;
+
+        double pixels = double(result.rows)*result.cols;
+
+        //the first call grows the buffers of the kernel
+        long before = allocationCount();
+
+        call.run();
+
+        result.firstCallAllocations = allocationCount() - before;
+
+        std::vector<double> seconds;
+
+        seconds.reserve(MAX_CALLS);
+
+        double total = 0;
+
+        before = allocationCount();
+
+        while ((total < minTime || int(seconds.size()) < MIN_CALLS) && int(seconds.size()) < MAX_CALLS)
+        {
+            Clock::time_point start = Clock::now();
+
+            call.run();
+
+            double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+            seconds.push_back(elapsed);
+            total += elapsed;
+        }//while
+
+        result.calls       = int(seconds.size());
+        result.allocations = double(allocationCount() - before)/result.calls;
+
+        if (!BENCHMARK_COUNTS_ALLOCATIONS)
+        {
+            result.firstCallAllocations = -1;
+            result.allocations          = -1;
+        }//if
+
+        std::sort(seconds.begin(), seconds.end());
+
+        double median = seconds[seconds.size()/2];
+
+        result.medianNs    = median*1e9/pixels;
+        result.fastestNs   = seconds[0]*1e9/pixels;
+        result.gbPerSecond = median > 0 ? call.bytes/median*1e-9 : 0;
+    }//measure
+
+    bool writeJson(const std::vector<BenchmarkResult>& results) const
+    {
+        FILE* file = jsonFile.empty() ? stdout : fopen(jsonFile.c_str(), "w");
+
+        if (file == NULL)
+        {
+            fprintf(stderr, "%s: cannot be written\n", jsonFile.c_str());
+
+            return false;
+        }//if
+
+        fprintf(file, "{\n  \"program\": \"%s\",\n  \"threads\": %u,\n  \"min_time\": %g,\n  \"results\": [\n",
+                program.c_str(), std::thread::hardware_concurrency(), minTime);
+
+        for (size_t k = 0; k < results.size(); k++)
+        {
+            const BenchmarkResult& r = results[k];
+
+            fprintf(file, "    {\"kernel\": \"%s\", \"size\": \"%s\", \"scene\": \"%s\", \"rows\": %d, \"cols\": %d, "
+                          "\"calls\": %d, \"ns_per_pixel\": %.4f, \"fastest_ns_per_pixel\": %.4f, \"gb_per_s\": %.3f, "
+                          "\"allocations\": %s, \"first_call_allocations\": %s}%s\n",
+                    r.kernel.c_str(), r.size.c_str(), r.scene.c_str(), r.rows, r.cols,
+                    r.calls, r.medianNs, r.fastestNs, r.gbPerSecond,
+                    formatCount(r.allocations, "%.2f", "null").c_str(),
+                    formatCount(double(r.firstCallAllocations), "%.0f", "null").c_str(),
+                    k + 1 < results.size() ? "," : "");
+        }//for
+
+        fprintf(file, "  ]\n}\n");
+
+        return file == stdout ? fflush(file) == 0 : fclose(file) == 0;
+    }//writeJson
+
+    //an allocation count in the given format, or missing if it is -1
+    static std::string formatCount(double count, const char* format, const char* missing)
+    {
+        if (count < 0)
+        {
+            return missing;
+        }//if
+
+        char text[32];
+
+        snprintf(text, sizeof(text), format, count);
+
+        return text;
+    }//formatCount
+
+    //the value of "key": in a line of the JSON that writeJson() writes
+    static std::string field(const std::string& line, const std::string& key)
+    {
+        std::string quoted = "\"" + key + "\": ";
+        size_t      begin  = line.find(quoted);
+
+        if (begin == std::string::npos)
+        {
+            return "";
+        }//if
+
+        begin += quoted.size();
+
+        if (line[begin] == '"')
+        {
+            begin++;
+
+            return line.substr(begin, line.find('"', begin) - begin);
+        }//if
+
+        return line.substr(begin, line.find_first_of(",}", begin) - begin);
+    }//field
+
+    int compareToBaseline(const std::vector<BenchmarkResult>& results) const
+    {
+        FILE* file = fopen(baselineFile.c_str(), "r");
+
+        if (file == NULL)
+        {
+            fprintf(stderr, "%s: cannot be read\n", baselineFile.c_str());
+
+            return 2;
+        }//if
+
+        //the results of the baseline, one per line
+        std::vector<std::string> lines;
+        std::string              line;
+
+        for (int c = fgetc(file); c != EOF; c = fgetc(file))
+        {
+            if (c == '\n')
+            {
+                lines.push_back(line);
+                line.clear();
+            }//if
+            else
+            {
+                line += char(c);
+            }//else
+        }//for
+
+        lines.push_back(line);
+
+        fclose(file);
+
+        int regressions = 0;
+
+        fprintf(stderr, "\ncompared to %s, a ratio above %.2f is a regression:\n", baselineFile.c_str(), 1 + tolerance);
+
+        for (size_t k = 0; k < results.size(); k++)
+        {
+            const BenchmarkResult& r = results[k];
+
+            double baseline = 0;
+
+            for (size_t l = 0; l < lines.size() && baseline == 0; l++)
+            {
+                if (field(lines[l], "kernel") == r.kernel && field(lines[l], "size") == r.size && field(lines[l], "scene") == r.scene)
+                {
+                    baseline = atof(field(lines[l], "ns_per_pixel").c_str());
+                }//if
+            }//for
+
+            if (baseline <= 0)
+            {
+                fprintf(stderr, "%-24s %-6s %-6s not in the baseline\n", r.kernel.c_str(), r.size.c_str(), r.scene.c_str());
+
+                continue;
+            }//if
+
+            double ratio   = r.medianNs/baseline;
+            bool   slower  = ratio > 1 + tolerance;
+            bool   faster  = ratio < 1 - tolerance;
+
+            fprintf(stderr, "%-24s %-6s %-6s %12.3f -> %12.3f ns/pixel %6.2fx%s\n",
+                    r.kernel.c_str(), r.size.c_str(), r.scene.c_str(), baseline, r.medianNs, ratio,
+                    slower ? "  REGRESSION" : faster ? "  faster" : "");
+
+            regressions += slower;
+        }//for
+
+        fprintf(stderr, "%d regression(s)\n", regressions);
+
+        return regressions > 0 ? 1 : 0;
+    }//compareToBaseline
+
+    std::string program;
+    bool        benchmarking;
+    std::string jsonFile;
+    std::string baselineFile;
+    double      tolerance;
+    double      minTime;
+
+    std::vector<std::string> sizes;       //empty for all
+    std::vector<std::string> kernelNames; //empty for all
+
+    std::vector<std::string> kernels;
+    std::vector<Setup>       setups;
+};//class Benchmark
+
+#endif /* BENCHMARK_HPP_ */
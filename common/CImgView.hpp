@@ -0,0 +1,68 @@
+//CImgView.hpp
+//
+//Zero-copy ImageViews of CImg buffers.
+//
+//CImg stores its channels as separate planes of width x height values, so a
+//color CImg is viewed as one single channel ImageView per plane. Pixel (i, j)
+//of a plane view is img(j, i, 0, channel).
+
+#ifndef CIMGVIEW_HPP_
+#define CIMGVIEW_HPP_
+
+#include <cassert>
+#include <CImg.h>
+#include "Image.hpp"
+
+//the view is only valid until the CImg is reallocated or destroyed
+template <typename T>
+inline ImageView<T> cimgPlane(cimg_library::CImg<T>& img, int channel)
+{
+    assert(channel >= 0 && channel < img.spectrum() && img.depth() == 1);
+
+    return ImageView<T>(img.data(0, 0, 0, channel), img.height(), img.width(), sizeof(T)*img.width());
+}//cimgPlane
+
+template <typename T>
+inline ImageView<const T> cimgPlane(const cimg_library::CImg<T>& img, int channel)
+{
+    return cimgPlane(const_cast<cimg_library::CImg<T>&>(img), channel);
+}//cimgPlane
+
+//the three planes of an RGB CImg
+template <typename T>
+struct PlanarRGBView
+{
+    ImageView<T> R;
+    ImageView<T> G;
+    ImageView<T> B;
+};//struct PlanarRGBView
+
+template <typename T>
+inline PlanarRGBView<T> cimgPlanes(cimg_library::CImg<T>& img)
+{
+    assert(img.spectrum() >= 3);
+
+    PlanarRGBView<T> view;
+
+    view.R = cimgPlane(img, 0);
+    view.G = cimgPlane(img, 1);
+    view.B = cimgPlane(img, 2);
+
+    return view;
+}//cimgPlanes
+
+template <typename T>
+inline PlanarRGBView<const T> cimgPlanes(const cimg_library::CImg<T>& img)
+{
+    assert(img.spectrum() >= 3);
+
+    PlanarRGBView<const T> view;
+
+    view.R = cimgPlane(img, 0);
+    view.G = cimgPlane(img, 1);
+    view.B = cimgPlane(img, 2);
+
+    return view;
+}//cimgPlanes
+
+#endif /* CIMGVIEW_HPP_ */
@@ -0,0 +1,476 @@
+//Derivatives.hpp
+//
+//3x3 Prewitt, Sobel and Scharr derivatives with SSE4.1, AVX2 and AVX-512
+//kernels and a scalar reference.
+//
+//All three kernels are separable into a [-1, 0, 1] difference across the
+//edge and an [a, b, a] smoothing along it:
+//
+//    Gx = [a; b; a] * [-1, 0, 1]        Gy = [-1; 0; 1] * [a, b, a]
+//
+//Gx is positive when the image gets brighter to the right, Gy when it gets
+//brighter downwards. Both are computed from the same three input rows in
+//one pass, difference first and smoothing second, in the same order in
+//every kernel, so the vector kernels give bit-identical results to the
+//scalar reference. Gray32f input gives Gray32f derivatives, Gray8 input gives
+//exact Gray16s derivatives (at most 16*255 in magnitude for Scharr).
+//
+//The outermost rows and columns of the derivatives are 0.
+
+#ifndef DERIVATIVES_HPP_
+#define DERIVATIVES_HPP_
+
+#include <cassert>
+#include "Image.hpp"
+#include "PixelFormats.hpp"
+#include "Simd.hpp"
+#include "ThreadPool.hpp"
+
+enum DerivativeKernel
+{
+    PREWITT_KERNEL, //[1, 1, 1]
+    SOBEL_KERNEL,   //[1, 2, 1]
+    SCHARR_KERNEL   //[3, 10, 3]
+};
+
+//the smoothing taps [a, b, a] of a kernel
+struct DerivativeWeights
+{
+    int a;
+    int b;
+};//struct DerivativeWeights
+
+inline DerivativeWeights derivativeWeights(DerivativeKernel kernel)
+{
+    DerivativeWeights weights;
+
+    switch (kernel)
+    {
+    case SOBEL_KERNEL:
+        weights.a = 1;
+        weights.b = 2;
+        break;
+
+    case SCHARR_KERNEL:
+        weights.a = 3;
+        weights.b = 10;
+        break;
+
+    default:
+        weights.a = 1;
+        weights.b = 1;
+        break;
+    }//switch
+
+    return weights;
+}//derivativeWeights
+
+//the format of the derivatives of an image
+template <typename In>
+struct DerivativeTraits;
+
+template <>
+struct DerivativeTraits<Gray8>
+{
+    typedef Gray16s Gradient;
+};//struct DerivativeTraits<Gray8>
+
+template <>
+struct DerivativeTraits<Gray32f>
+{
+    typedef Gray32f Gradient;
+};//struct DerivativeTraits<Gray32f>
+
+//computes columns 1 .. cols - 2 of one row of derivatives from the rows
+//above, at and below it
+template <typename In, typename Out>
+using DerivativeRowFunction = void (*)(const In* above, const In* mid, const In* below,
+                                       Out* gx, Out* gy, int cols, DerivativeWeights weights);
+
+//the vector kernels and the scalar reference have to round the same way, so
+//mul + add must not be contracted into fused multiply-adds (AVX-512 and
+//-march=native builds would otherwise do it in some kernels but not others)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+//*****************************************************************************
+//scalar reference
+//*****************************************************************************
+
+//columns begin .. end - 1, the vector kernels use this for the last few
+//pixels of each row
+template <typename In, typename Out>
+inline void derivativeColumns(const In* above, const In* mid, const In* below,
+                              Out* gx, Out* gy, int begin, int end, DerivativeWeights weights)
+{
+    typedef typename PixelTraits<In>::Sum Sum;
+
+    const Sum a = Sum(weights.a);
+    const Sum b = Sum(weights.b);
+
+    for (int j = begin; j < end; j++)
+    {
+        Sum dxAbove = above[j + 1] - above[j - 1];
+        Sum dxMid   = mid  [j + 1] - mid  [j - 1];
+        Sum dxBelow = below[j + 1] - below[j - 1];
+
+        Sum dyLeft  = below[j - 1] - above[j - 1];
+        Sum dyMid   = below[  j  ] - above[  j  ];
+        Sum dyRight = below[j + 1] - above[j + 1];
+
+        gx[j] = Out(a*dxAbove + b*dxMid + a*dxBelow);
+        gy[j] = Out(a*dyLeft  + b*dyMid + a*dyRight);
+    }//for
+}//derivativeColumns
+
+template <typename In, typename Out>
+inline void derivativeRowScalar(const In* above, const In* mid, const In* below,
+                                Out* gx, Out* gy, int cols, DerivativeWeights weights)
+{
+    derivativeColumns(above, mid, below, gx, gy, 1, cols - 1, weights);
+}//derivativeRowScalar
+
+//*****************************************************************************
+//vector kernels
+//*****************************************************************************
+
+#if SIMD_X86
+
+//each kernel handles as many whole vectors as fit in columns 1 .. cols - 2,
+//reading up to one pixel to the left and right of them, and leaves the
+//rest of the row to the scalar reference
+
+SIMD_TARGET_SSE41
+inline void derivativeRowSSE41(const Gray32f* above, const Gray32f* mid, const Gray32f* below,
+                               Gray32f* gx, Gray32f* gy, int cols, DerivativeWeights weights)
+{
+    const __m128 a = _mm_set1_ps(float(weights.a));
+    const __m128 b = _mm_set1_ps(float(weights.b));
+
+    int j = 1;
+
+    for (; j + 4 <= cols - 1; j += 4)
+    {
+        __m128 aboveLeft  = _mm_loadu_ps(above + j - 1);
+        __m128 aboveMid   = _mm_loadu_ps(above + j    );
+        __m128 aboveRight = _mm_loadu_ps(above + j + 1);
+        __m128 belowLeft  = _mm_loadu_ps(below + j - 1);
+        __m128 belowMid   = _mm_loadu_ps(below + j    );
+        __m128 belowRight = _mm_loadu_ps(below + j + 1);
+
+        __m128 dxAbove = _mm_sub_ps(aboveRight, aboveLeft);
+        __m128 dxMid   = _mm_sub_ps(_mm_loadu_ps(mid + j + 1), _mm_loadu_ps(mid + j - 1));
+        __m128 dxBelow = _mm_sub_ps(belowRight, belowLeft);
+
+        __m128 dyLeft  = _mm_sub_ps(belowLeft,  aboveLeft );
+        __m128 dyMid   = _mm_sub_ps(belowMid,   aboveMid  );
+        __m128 dyRight = _mm_sub_ps(belowRight, aboveRight);
+
+        _mm_storeu_ps(gx + j, _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, dxAbove), _mm_mul_ps(b, dxMid)), _mm_mul_ps(a, dxBelow)));
+        _mm_storeu_ps(gy + j, _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, dyLeft ), _mm_mul_ps(b, dyMid)), _mm_mul_ps(a, dyRight)));
+    }//for
+
+    derivativeColumns(above, mid, below, gx, gy, j, cols - 1, weights);
+}//derivativeRowSSE41
+
+SIMD_TARGET_AVX2
+inline void derivativeRowAVX2(const Gray32f* above, const Gray32f* mid, const Gray32f* below,
+                              Gray32f* gx, Gray32f* gy, int cols, DerivativeWeights weights)
+{
+    const __m256 a = _mm256_set1_ps(float(weights.a));
+    const __m256 b = _mm256_set1_ps(float(weights.b));
+
+    int j = 1;
+
+    for (; j + 8 <= cols - 1; j += 8)
+    {
+        __m256 aboveLeft  = _mm256_loadu_ps(above + j - 1);
+        __m256 aboveMid   = _mm256_loadu_ps(above + j    );
+        __m256 aboveRight = _mm256_loadu_ps(above + j + 1);
+        __m256 belowLeft  = _mm256_loadu_ps(below + j - 1);
+        __m256 belowMid   = _mm256_loadu_ps(below + j    );
+        __m256 belowRight = _mm256_loadu_ps(below + j + 1);
+
+        __m256 dxAbove = _mm256_sub_ps(aboveRight, aboveLeft);
+        __m256 dxMid   = _mm256_sub_ps(_mm256_loadu_ps(mid + j + 1), _mm256_loadu_ps(mid + j - 1));
+        __m256 dxBelow = _mm256_sub_ps(belowRight, belowLeft);
+
+        __m256 dyLeft  = _mm256_sub_ps(belowLeft,  aboveLeft );
+        __m256 dyMid   = _mm256_sub_ps(belowMid,   aboveMid  );
+        __m256 dyRight = _mm256_sub_ps(belowRight, aboveRight);
+
+        _mm256_storeu_ps(gx + j, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, dxAbove), _mm256_mul_ps(b, dxMid)), _mm256_mul_ps(a, dxBelow)));
+        _mm256_storeu_ps(gy + j, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, dyLeft ), _mm256_mul_ps(b, dyMid)), _mm256_mul_ps(a, dyRight)));
+    }//for
+
+    derivativeColumns(above, mid, below, gx, gy, j, cols - 1, weights);
+}//derivativeRowAVX2
+
+SIMD_TARGET_AVX512
+inline void derivativeRowAVX512(const Gray32f* above, const Gray32f* mid, const Gray32f* below,
+                                Gray32f* gx, Gray32f* gy, int cols, DerivativeWeights weights)
+{
+    const __m512 a = _mm512_set1_ps(float(weights.a));
+    const __m512 b = _mm512_set1_ps(float(weights.b));
+
+    int j = 1;
+
+    for (; j + 16 <= cols - 1; j += 16)
+    {
+        __m512 aboveLeft  = _mm512_loadu_ps(above + j - 1);
+        __m512 aboveMid   = _mm512_loadu_ps(above + j    );
+        __m512 aboveRight = _mm512_loadu_ps(above + j + 1);
+        __m512 belowLeft  = _mm512_loadu_ps(below + j - 1);
+        __m512 belowMid   = _mm512_loadu_ps(below + j    );
+        __m512 belowRight = _mm512_loadu_ps(below + j + 1);
+
+        __m512 dxAbove = _mm512_sub_ps(aboveRight, aboveLeft);
+        __m512 dxMid   = _mm512_sub_ps(_mm512_loadu_ps(mid + j + 1), _mm512_loadu_ps(mid + j - 1));
+        __m512 dxBelow = _mm512_sub_ps(belowRight, belowLeft);
+
+        __m512 dyLeft  = _mm512_sub_ps(belowLeft,  aboveLeft );
+        __m512 dyMid   = _mm512_sub_ps(belowMid,   aboveMid  );
+        __m512 dyRight = _mm512_sub_ps(belowRight, aboveRight);
+
+        _mm512_storeu_ps(gx + j, _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(a, dxAbove), _mm512_mul_ps(b, dxMid)), _mm512_mul_ps(a, dxBelow)));
+        _mm512_storeu_ps(gy + j, _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(a, dyLeft ), _mm512_mul_ps(b, dyMid)), _mm512_mul_ps(a, dyRight)));
+    }//for
+
+    derivativeColumns(above, mid, below, gx, gy, j, cols - 1, weights);
+}//derivativeRowAVX512
+
+//the 8 bit kernels widen each pixel to 16 bits, which holds every Scharr
+//derivative of an 8 bit image exactly
+
+SIMD_TARGET_SSE41
+inline void derivativeRowSSE41(const Gray8* above, const Gray8* mid, const Gray8* below,
+                               Gray16s* gx, Gray16s* gy, int cols, DerivativeWeights weights)
+{
+    const __m128i a = _mm_set1_epi16(short(weights.a));
+    const __m128i b = _mm_set1_epi16(short(weights.b));
+
+    int j = 1;
+
+    for (; j + 8 <= cols - 1; j += 8)
+    {
+        __m128i aboveLeft  = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(above + j - 1)));
+        __m128i aboveMid   = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(above + j    )));
+        __m128i aboveRight = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(above + j + 1)));
+        __m128i midLeft    = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(mid   + j - 1)));
+        __m128i midRight   = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(mid   + j + 1)));
+        __m128i belowLeft  = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(below + j - 1)));
+        __m128i belowMid   = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(below + j    )));
+        __m128i belowRight = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(below + j + 1)));
+
+        __m128i dxAbove = _mm_sub_epi16(aboveRight, aboveLeft);
+        __m128i dxMid   = _mm_sub_epi16(midRight,   midLeft  );
+        __m128i dxBelow = _mm_sub_epi16(belowRight, belowLeft);
+
+        __m128i dyLeft  = _mm_sub_epi16(belowLeft,  aboveLeft );
+        __m128i dyMid   = _mm_sub_epi16(belowMid,   aboveMid  );
+        __m128i dyRight = _mm_sub_epi16(belowRight, aboveRight);
+
+        __m128i sumX = _mm_add_epi16(_mm_mullo_epi16(a, _mm_add_epi16(dxAbove, dxBelow)), _mm_mullo_epi16(b, dxMid));
+        __m128i sumY = _mm_add_epi16(_mm_mullo_epi16(a, _mm_add_epi16(dyLeft,  dyRight)), _mm_mullo_epi16(b, dyMid));
+
+        _mm_storeu_si128((__m128i*)(gx + j), sumX);
+        _mm_storeu_si128((__m128i*)(gy + j), sumY);
+    }//for
+
+    derivativeColumns(above, mid, below, gx, gy, j, cols - 1, weights);
+}//derivativeRowSSE41
+
+SIMD_TARGET_AVX2
+inline void derivativeRowAVX2(const Gray8* above, const Gray8* mid, const Gray8* below,
+                              Gray16s* gx, Gray16s* gy, int cols, DerivativeWeights weights)
+{
+    const __m256i a = _mm256_set1_epi16(short(weights.a));
+    const __m256i b = _mm256_set1_epi16(short(weights.b));
+
+    int j = 1;
+
+    for (; j + 16 <= cols - 1; j += 16)
+    {
+        __m256i aboveLeft  = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(above + j - 1)));
+        __m256i aboveMid   = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(above + j    )));
+        __m256i aboveRight = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(above + j + 1)));
+        __m256i midLeft    = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(mid   + j - 1)));
+        __m256i midRight   = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(mid   + j + 1)));
+        __m256i belowLeft  = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(below + j - 1)));
+        __m256i belowMid   = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(below + j    )));
+        __m256i belowRight = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(below + j + 1)));
+
+        __m256i dxAbove = _mm256_sub_epi16(aboveRight, aboveLeft);
+        __m256i dxMid   = _mm256_sub_epi16(midRight,   midLeft  );
+        __m256i dxBelow = _mm256_sub_epi16(belowRight, belowLeft);
+
+        __m256i dyLeft  = _mm256_sub_epi16(belowLeft,  aboveLeft );
+        __m256i dyMid   = _mm256_sub_epi16(belowMid,   aboveMid  );
+        __m256i dyRight = _mm256_sub_epi16(belowRight, aboveRight);
+
+        __m256i sumX = _mm256_add_epi16(_mm256_mullo_epi16(a, _mm256_add_epi16(dxAbove, dxBelow)), _mm256_mullo_epi16(b, dxMid));
+        __m256i sumY = _mm256_add_epi16(_mm256_mullo_epi16(a, _mm256_add_epi16(dyLeft,  dyRight)), _mm256_mullo_epi16(b, dyMid));
+
+        _mm256_storeu_si256((__m256i*)(gx + j), sumX);
+        _mm256_storeu_si256((__m256i*)(gy + j), sumY);
+    }//for
+
+    derivativeColumns(above, mid, below, gx, gy, j, cols - 1, weights);
+}//derivativeRowAVX2
+
+SIMD_TARGET_AVX512
+inline void derivativeRowAVX512(const Gray8* above, const Gray8* mid, const Gray8* below,
+                                Gray16s* gx, Gray16s* gy, int cols, DerivativeWeights weights)
+{
+    const __m512i a = _mm512_set1_epi16(short(weights.a));
+    const __m512i b = _mm512_set1_epi16(short(weights.b));
+
+    int j = 1;
+
+    for (; j + 32 <= cols - 1; j += 32)
+    {
+        __m512i aboveLeft  = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(above + j - 1)));
+        __m512i aboveMid   = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(above + j    )));
+        __m512i aboveRight = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(above + j + 1)));
+        __m512i midLeft    = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(mid   + j - 1)));
+        __m512i midRight   = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(mid   + j + 1)));
+        __m512i belowLeft  = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(below + j - 1)));
+        __m512i belowMid   = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(below + j    )));
+        __m512i belowRight = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(below + j + 1)));
+
+        __m512i dxAbove = _mm512_sub_epi16(aboveRight, aboveLeft);
+        __m512i dxMid   = _mm512_sub_epi16(midRight,   midLeft  );
+        __m512i dxBelow = _mm512_sub_epi16(belowRight, belowLeft);
+
+        __m512i dyLeft  = _mm512_sub_epi16(belowLeft,  aboveLeft );
+        __m512i dyMid   = _mm512_sub_epi16(belowMid,   aboveMid  );
+        __m512i dyRight = _mm512_sub_epi16(belowRight, aboveRight);
+
+        __m512i sumX = _mm512_add_epi16(_mm512_mullo_epi16(a, _mm512_add_epi16(dxAbove, dxBelow)), _mm512_mullo_epi16(b, dxMid));
+        __m512i sumY = _mm512_add_epi16(_mm512_mullo_epi16(a, _mm512_add_epi16(dyLeft,  dyRight)), _mm512_mullo_epi16(b, dyMid));
+
+        _mm512_storeu_si512((void*)(gx + j), sumX);
+        _mm512_storeu_si512((void*)(gy + j), sumY);
+    }//for
+
+    derivativeColumns(above, mid, below, gx, gy, j, cols - 1, weights);
+}//derivativeRowAVX512
+
+#endif /* SIMD_X86 */
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC pop_options
+#endif
+
+//*****************************************************************************
+//dispatch
+//*****************************************************************************
+
+//the row kernel for a level. Levels above what was compiled in fall back to
+//the best one that was.
+template <typename In, typename Out>
+inline DerivativeRowFunction<In, Out> derivativeRowFunction(SimdLevel level)
+{
+#if SIMD_X86
+    switch (level)
+    {
+    case SIMD_AVX512: return derivativeRowAVX512;
+    case SIMD_AVX2:   return derivativeRowAVX2;
+    case SIMD_SSE41:  return derivativeRowSSE41;
+    default:          break;
+    }//switch
+#endif
+
+    return derivativeRowScalar<In, Out>;
+}//derivativeRowFunction
+
+//one whole row of derivatives, including the zero border columns
+template <typename In, typename Out>
+inline void derivativeRow(const In* above, const In* mid, const In* below, Out* gx, Out* gy, int cols,
+                          DerivativeKernel kernel, SimdLevel level = simdLevel())
+{
+    gx[0]        = 0;
+    gy[0]        = 0;
+    gx[cols - 1] = 0;
+    gy[cols - 1] = 0;
+
+    derivativeRowFunction<In, Out>(level)(above, mid, below, gx, gy, cols, derivativeWeights(kernel));
+}//derivativeRow
+
+//computes gx and gy, which have to be the same size as the input, one row
+//at a time, in bands of rows that run on the thread pool. The kernel is
+//looked up once per image; pass SIMD_SCALAR as the level to get the
+//reference result.
+template <typename In, typename Out>
+inline void derivativeImage(const ImageView<const In>& input, const ImageView<Out>& gx, const ImageView<Out>& gy,
+                            DerivativeKernel kernel, SimdLevel level)
+{
+    assert(gx.sameSize(input) && gy.sameSize(input));
+
+    int rows = input.rows;
+    int cols = input.cols;
+
+    DerivativeRowFunction<In, Out> rowFunction = derivativeRowFunction<In, Out>(level);
+    DerivativeWeights              weights     = derivativeWeights(kernel);
+
+    parallelForRows(0, rows, 1, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            Out* g_x = gx.row(i);
+            Out* g_y = gy.row(i);
+
+            g_x[0]        = 0;
+            g_y[0]        = 0;
+            g_x[cols - 1] = 0;
+            g_y[cols - 1] = 0;
+
+            if (i == 0 || i == rows - 1)
+            {
+                for (int j = 0; j < cols; j++)
+                {
+                    g_x[j] = 0;
+                    g_y[j] = 0;
+                }//for
+            }//if
+            else
+            {
+                rowFunction(input.row(i - 1), input.row(i), input.row(i + 1), g_x, g_y, cols, weights);
+            }//else
+        }//for
+    });
+}//derivativeImage
+
+inline void derivatives(const ImageView<const Gray32f>& input, const ImageView<Gray32f>& gx, const ImageView<Gray32f>& gy,
+                        DerivativeKernel kernel, SimdLevel level = simdLevel())
+{
+    derivativeImage(input, gx, gy, kernel, level);
+}//derivatives
+
+inline void derivatives(const ImageView<const Gray8>& input, const ImageView<Gray16s>& gx, const ImageView<Gray16s>& gy,
+                        DerivativeKernel kernel, SimdLevel level = simdLevel())
+{
+    derivativeImage(input, gx, gy, kernel, level);
+}//derivatives
+
+inline void derivatives(const ImageView<const Gray32f>& input, Image<Gray32f>& gx, Image<Gray32f>& gy,
+                        DerivativeKernel kernel, SimdLevel level = simdLevel())
+{
+    gx.create(input.rows, input.cols);
+    gy.create(input.rows, input.cols);
+
+    derivativeImage(input, ImageView<Gray32f>(gx), ImageView<Gray32f>(gy), kernel, level);
+}//derivatives
+
+inline void derivatives(const ImageView<const Gray8>& input, Image<Gray16s>& gx, Image<Gray16s>& gy,
+                        DerivativeKernel kernel, SimdLevel level = simdLevel())
+{
+    gx.create(input.rows, input.cols);
+    gy.create(input.rows, input.cols);
+
+    derivativeImage(input, ImageView<Gray16s>(gx), ImageView<Gray16s>(gy), kernel, level);
+}//derivatives
+
+#endif /* DERIVATIVES_HPP_ */
@@ -0,0 +1,238 @@
+//FrameSinks.hpp
+//
+//The command line of the video programs, and the sinks their frames go to.
+//
+//Every program runs the same way:
+//
+//    program [--headless] [--out DIR] [INPUT ...]
+//
+//Each INPUT is a video file, a camera device, or an image sequence such as
+//frame_%04d.png, as cv::VideoCapture reads them, and the inputs are run one
+//after the other. The display is only one of the sinks: with --headless no
+//window is made and nothing waits for a key, the results the worker reports
+//for each frame (corners, circles, lines, ...) are printed to stdout, and the
+//frames are processed as fast as the pipeline can take them. With --out the
+//output image of every frame is also written into DIR, as
+//<input>_<frame>.png. A summary of each input, with the frame rate, goes to
+//stderr.
+
+#ifndef FRAMESINKS_HPP_
+#define FRAMESINKS_HPP_
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdarg>
+#include "VideoPipeline.hpp"
+
+struct RunOptions
+{
+    bool                     headless;  //no window, the results go to stdout
+    std::string              outputDir; //the output images are written here, if not empty
+    std::vector<std::string> inputs;    //videos, run in order
+
+    RunOptions() : headless(false) {}
+};//struct RunOptions
+
+//false, after printing the usage to stderr, for an option that is not known.
+//When no input is given, defaultInput is run.
+inline bool parseRunOptions(int argc, char** argv, const std::string& defaultInput, RunOptions& options)
+{
+    for (int k = 1; k < argc; k++)
+    {
+        if (strcmp(argv[k], "--headless") == 0)
+        {
+            options.headless = true;
+        }//if
+        else if (strcmp(argv[k], "--out") == 0 && k + 1 < argc)
+        {
+            options.outputDir = argv[++k];
+        }//else if
+        else if (argv[k][0] == '-' && argv[k][1] == '-')
+        {
+            fprintf(stderr, "usage: %s [--headless] [--out DIR] [INPUT ...]\n", argv[0]);
+
+            return false;
+        }//else if
+        else
+        {
+            options.inputs.push_back(argv[k]);
+        }//else
+    }//for
+
+    if (options.inputs.empty())
+    {
+        options.inputs.push_back(defaultInput);
+    }//if
+
+    return true;
+}//parseRunOptions
+
+//appends printf style text to the results of a frame
+inline void appendResult(std::string& results, const char* format, ...)
+{
+    char line[256];
+
+    va_list args;
+    va_start(args, format);
+
+    int length = vsnprintf(line, sizeof(line), format, args);
+
+    va_end(args);
+
+    results.append(line, std::min(std::max(length, 0), int(sizeof(line)) - 1));
+}//appendResult
+
+//shows the input and the output of a frame in two windows, and stops the
+//video when ESC is pressed
+class WindowSink
+{
+public:
+    WindowSink()
+    {
+        cv::namedWindow("input" , CV_WINDOW_NORMAL);
+        cv::namedWindow("output", CV_WINDOW_NORMAL);
+    }//WindowSink
+
+    bool operator()(const VideoFrame& frame)
+    {
+        const int  TIME_TO_WAIT_FOR_INPUT = 1; //set to 0 for infinite
+        const char ESC_KEY_CODE           = char(27);
+
+        cv::imshow("input" , frame.input);
+        cv::imshow("output", frame.output);
+
+        char c = cv::waitKey(TIME_TO_WAIT_FOR_INPUT);
+
+        return c != ESC_KEY_CODE;
+    }//operator()
+};//class WindowSink
+
+//prints the results of a frame to a stream, a line per result, each led by
+//the input and the frame number, and writes the output image into a
+//directory when one is given
+class FileSink
+{
+public:
+    FileSink(FILE* stream, const std::string& outputDir) : stream(stream), outputDir(outputDir) {}
+
+    //the frames that follow come from input
+    void setInput(const std::string& input)
+    {
+        size_t slash = input.find_last_of("/\\");
+        size_t dot   = input.find_last_of('.');
+
+        name = input.substr(slash == std::string::npos ? 0 : slash + 1);
+
+        if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+        {
+            name.resize(dot - (slash == std::string::npos ? 0 : slash + 1));
+        }//if
+    }//setInput
+
+    bool operator()(const VideoFrame& frame)
+    {
+        for (size_t begin = 0; begin < frame.results.size(); )
+        {
+            size_t end = frame.results.find('\n', begin);
+
+            if (end == std::string::npos)
+            {
+                end = frame.results.size();
+            }//if
+
+            fprintf(stream, "%s %d %.*s\n", name.c_str(), frame.number, int(end - begin), frame.results.data() + begin);
+
+            begin = end + 1;
+        }//for
+
+        if (!outputDir.empty())
+        {
+            char fileName[32];
+
+            snprintf(fileName, sizeof(fileName), "_%06d.png", frame.number);
+
+            cv::imwrite(outputDir + "/" + name + fileName, frame.output);
+        }//if
+
+        return true;
+    }//operator()
+
+private:
+    FILE*       stream;
+    std::string outputDir;
+    std::string name; //of the input, without the directory and the extension
+};//class FileSink
+
+//runs each input of the options through the pipeline into the sinks they ask
+//for, the window unless the run is headless, and the files or stdout
+template <typename Worker>
+void runInputs(VideoPipeline<Worker>& pipeline, const RunOptions& options)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    std::unique_ptr<WindowSink> window(options.headless ? NULL : new WindowSink());
+
+    bool     toFiles = options.headless || !options.outputDir.empty();
+    FileSink files(stdout, options.outputDir);
+
+    for (size_t k = 0; k < options.inputs.size(); k++)
+    {
+        cv::VideoCapture video(options.inputs[k]);
+
+        if (!video.isOpened())
+        {
+            fprintf(stderr, "%s: cannot be opened\n", options.inputs[k].c_str());
+
+            continue;
+        }//if
+
+        files.setInput(options.inputs[k]);
+
+        int               frameCount = 0;
+        bool              stopped    = false;
+        Clock::time_point start      = Clock::now();
+
+        pipeline.run(video, [&](const VideoFrame& frame)
+        {
+            frameCount++;
+
+            bool going = true;
+
+            if (toFiles)
+            {
+                going = files(frame);
+            }//if
+
+            if (window)
+            {
+                going = (*window)(frame) && going;
+            }//if
+
+            stopped = !going;
+
+            return going;
+        });
+
+        fflush(stdout);
+
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        fprintf(stderr, "%s: %d frames in %.3f s, %.1f frames/s, %d dropped\n",
+                options.inputs[k].c_str(), frameCount, seconds,
+                seconds > 0 ? frameCount/seconds : 0.0, pipeline.droppedFrames());
+
+        if (stopped)
+        {
+            break;
+        }//if
+    }//for
+}//runInputs
+
+#endif /* FRAMESINKS_HPP_ */
@@ -0,0 +1,596 @@
+//Gaussian.hpp
+//
+//Separable 7 tap gaussian smoothing with a fixed point mode and a floating
+//point reference.
+//
+//The mask is symmetric, [w3, w2, w1, w0, w1, w2, w3]. Each row is first
+//smoothed horizontally into a ring of 7 line buffers, and each output row is
+//then the vertical mask applied to the 7 horizontally smoothed rows around
+//it. The pixels within 3 of the left and right edges keep their input value
+//in the horizontal pass, and the rows within 3 of the top and bottom edges
+//only get the horizontal pass.
+//
+//Gray32f images are smoothed in floating point with the weights as given.
+//Gray8 images are smoothed in 16 bit fixed point: the weights are rounded to
+//1/256ths that sum to exactly 256, the horizontal pass keeps 7 fractional
+//bits in a uint16_t, and the taps at the same distance from the center are
+//added before they are multiplied, so both passes need 4 multiplies per
+//pixel instead of 7, and a vector instruction handles 8, 16 or 32 pixels.
+//The vector kernels give bit-identical results to the scalar reference.
+//
+//The result is not within one gray level of the floating point mode. The
+//rounding in the two passes adds less than 0.55 of a level, but the weights
+//rounded to 1/256ths make a slightly different mask: an output can be off
+//by up to 255 times the sum of the absolute differences of the two 2D
+//masks on top of that. With the weights of EDCircles, 0.383, 0.242, 0.061
+//and 0.006 (which sum to 1.001), the mask adds up to 2.2 levels on a worst
+//case input, so the bound is 2.7 levels. On random frames about 1% of the
+//pixels are more than one level off, by at most about 1.7.
+
+#ifndef GAUSSIAN_HPP_
+#define GAUSSIAN_HPP_
+
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include "Image.hpp"
+#include "PixelFormats.hpp"
+#include "Simd.hpp"
+#include "ThreadPool.hpp"
+
+const int GAUSSIAN_RADIUS = 3;
+const int GAUSSIAN_TAPS   = 2*GAUSSIAN_RADIUS + 1;
+
+//the fixed point horizontal pass keeps this many fractional bits
+const int GAUSSIAN_FRACTION_BITS = 7;
+
+struct GaussianWeights
+{
+    float term [GAUSSIAN_RADIUS + 1]; //w0 (the center) .. w3
+    int   fixed[GAUSSIAN_RADIUS + 1]; //the same in 1/256ths, w0 + 2*(w1 + w2 + w3) = 256
+};//struct GaussianWeights
+
+//the fixed point weights are rounded so that the mask still sums to 256:
+//they are rounded down, and the 1/256ths that are missing go to the taps
+//with the largest remainders, an outer tap taking two as it appears twice
+inline GaussianWeights gaussianWeights(float center, float term1, float term2, float term3)
+{
+    GaussianWeights weights;
+
+    weights.term[0] = center;
+    weights.term[1] = term1;
+    weights.term[2] = term2;
+    weights.term[3] = term3;
+
+    double total = double(center) + 2.0*(double(term1) + double(term2) + double(term3));
+
+    double remainder[GAUSSIAN_RADIUS + 1];
+    int    sum = 0;
+
+    for (int k = 0; k <= GAUSSIAN_RADIUS; k++)
+    {
+        double scaled = weights.term[k]/total*256;
+
+        weights.fixed[k] = int(floor(scaled));
+        remainder[k]     = scaled - weights.fixed[k];
+
+        sum += (k == 0 ? 1 : 2)*weights.fixed[k];
+    }//for
+
+    while (sum < 256)
+    {
+        int best = -1;
+
+        for (int k = 0; k <= GAUSSIAN_RADIUS; k++)
+        {
+            int cost = (k == 0 ? 1 : 2);
+
+            if (sum + cost <= 256 && (best < 0 || remainder[k] > remainder[best]))
+            {
+                best = k;
+            }//if
+        }//for
+
+        weights.fixed[best]++;
+        remainder[best] -= 1;
+
+        sum += (best == 0 ? 1 : 2);
+    }//while
+
+    return weights;
+}//gaussianWeights
+
+//the format of the horizontally smoothed rows
+template <typename T>
+struct GaussianTraits;
+
+template <>
+struct GaussianTraits<Gray32f>
+{
+    typedef Gray32f Horizontal;
+};//struct GaussianTraits<Gray32f>
+
+template <>
+struct GaussianTraits<Gray8>
+{
+    typedef uint16_t Horizontal; //GAUSSIAN_FRACTION_BITS fractional bits
+};//struct GaussianTraits<Gray8>
+
+//whether row i has the whole vertical mask inside the image
+inline bool gaussianFullWindow(int i, int rows)
+{
+    return i >= GAUSSIAN_RADIUS && i < rows - GAUSSIAN_RADIUS;
+}//gaussianFullWindow
+
+//*****************************************************************************
+//floating point reference
+//*****************************************************************************
+
+//the level is not used, it is only taken so that the row functions of both
+//formats are called alike
+inline void gaussianRowHorizontal(const Gray32f* in, Gray32f* out, int cols,
+                                  const GaussianWeights& weights, SimdLevel = simdLevel())
+{
+    const float* w = weights.term;
+
+    int left  = std::min(GAUSSIAN_RADIUS, cols);
+    int right = std::max(cols - GAUSSIAN_RADIUS, left);
+
+    for (int j = 0; j < left; j++)
+    {
+        out[j] = in[j];
+    }//for
+
+    for (int j = GAUSSIAN_RADIUS; j < cols - GAUSSIAN_RADIUS; j++)
+    {
+        out[j] = w[3]*in[j - 3]
+                +w[2]*in[j - 2]
+                +w[1]*in[j - 1]
+                +w[0]*in[  j  ]
+                +w[1]*in[j + 1]
+                +w[2]*in[j + 2]
+                +w[3]*in[j + 3];
+    }//for
+
+    for (int j = right; j < cols; j++)
+    {
+        out[j] = in[j];
+    }//for
+}//gaussianRowHorizontal
+
+//rows[k] is horizontally smoothed row i - 3 + k
+inline void gaussianRowVertical(const Gray32f* const* rows, Gray32f* out, int cols,
+                                const GaussianWeights& weights, SimdLevel = simdLevel())
+{
+    const float* w = weights.term;
+
+    for (int j = 0; j < cols; j++)
+    {
+        out[j] = w[3]*rows[0][j]
+                +w[2]*rows[1][j]
+                +w[1]*rows[2][j]
+                +w[0]*rows[3][j]
+                +w[1]*rows[4][j]
+                +w[2]*rows[5][j]
+                +w[3]*rows[6][j];
+    }//for
+}//gaussianRowVertical
+
+//a row without the whole vertical mask keeps its horizontal result
+inline void gaussianRowFinish(const Gray32f* row, Gray32f* out, int cols)
+{
+    std::copy(row, row + cols, out);
+}//gaussianRowFinish
+
+//*****************************************************************************
+//fixed point, scalar reference
+//*****************************************************************************
+
+//columns begin .. end - 1 of the horizontal pass, which have to be at
+//least 3 pixels from either edge
+inline void gaussianColumnsHorizontal(const Gray8* in, uint16_t* out, int begin, int end, const GaussianWeights& weights)
+{
+    const int* w = weights.fixed;
+
+    for (int j = begin; j < end; j++)
+    {
+        int sum = w[0]*in[j]
+                + w[1]*(in[j - 1] + in[j + 1])
+                + w[2]*(in[j - 2] + in[j + 2])
+                + w[3]*(in[j - 3] + in[j + 3]);
+
+        //8 fractional bits down to 7, rounded
+        out[j] = uint16_t((sum + 1) >> 1);
+    }//for
+}//gaussianColumnsHorizontal
+
+//each product is rounded down to 7 fractional bits before the sum, which
+//is what the 16 bit high multiply of the vector kernels does
+inline void gaussianColumnsVertical(const uint16_t* const* rows, Gray8* out, int begin, int end, const GaussianWeights& weights)
+{
+    const int* w = weights.fixed;
+
+    const int ROUND = 1 << (GAUSSIAN_FRACTION_BITS - 1);
+
+    for (int j = begin; j < end; j++)
+    {
+        int sum = ((w[0]* rows[3][j]              ) >> 8)
+                + ((w[1]*(rows[2][j] + rows[4][j])) >> 8)
+                + ((w[2]*(rows[1][j] + rows[5][j])) >> 8)
+                + ((w[3]*(rows[0][j] + rows[6][j])) >> 8);
+
+        out[j] = Gray8((sum + ROUND) >> GAUSSIAN_FRACTION_BITS);
+    }//for
+}//gaussianColumnsVertical
+
+//*****************************************************************************
+//fixed point, vector kernels
+//*****************************************************************************
+
+#if SIMD_X86
+
+//each kernel handles as many whole vectors as fit in the columns it has to
+//compute, and leaves the rest of the row to the scalar reference
+
+SIMD_TARGET_SSE41
+inline int gaussianHorizontalSSE41(const Gray8* in, uint16_t* out, int cols, const GaussianWeights& weights)
+{
+    const __m128i w0 = _mm_set1_epi16(short(weights.fixed[0]));
+    const __m128i w1 = _mm_set1_epi16(short(weights.fixed[1]));
+    const __m128i w2 = _mm_set1_epi16(short(weights.fixed[2]));
+    const __m128i w3 = _mm_set1_epi16(short(weights.fixed[3]));
+
+    int j = GAUSSIAN_RADIUS;
+
+    for (; j + 8 <= cols - GAUSSIAN_RADIUS; j += 8)
+    {
+        __m128i left3  = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(in + j - 3)));
+        __m128i left2  = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(in + j - 2)));
+        __m128i left1  = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(in + j - 1)));
+        __m128i center = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(in + j    )));
+        __m128i right1 = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(in + j + 1)));
+        __m128i right2 = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(in + j + 2)));
+        __m128i right3 = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(in + j + 3)));
+
+        //at most 255*256, so the sum fits in 16 unsigned bits
+        __m128i sum = _mm_mullo_epi16(center, w0);
+
+        sum = _mm_add_epi16(sum, _mm_mullo_epi16(_mm_add_epi16(left1, right1), w1));
+        sum = _mm_add_epi16(sum, _mm_mullo_epi16(_mm_add_epi16(left2, right2), w2));
+        sum = _mm_add_epi16(sum, _mm_mullo_epi16(_mm_add_epi16(left3, right3), w3));
+
+        //(sum + 1) >> 1 without overflowing
+        _mm_storeu_si128((__m128i*)(out + j), _mm_avg_epu16(sum, _mm_setzero_si128()));
+    }//for
+
+    return j;
+}//gaussianHorizontalSSE41
+
+SIMD_TARGET_AVX2
+inline int gaussianHorizontalAVX2(const Gray8* in, uint16_t* out, int cols, const GaussianWeights& weights)
+{
+    const __m256i w0 = _mm256_set1_epi16(short(weights.fixed[0]));
+    const __m256i w1 = _mm256_set1_epi16(short(weights.fixed[1]));
+    const __m256i w2 = _mm256_set1_epi16(short(weights.fixed[2]));
+    const __m256i w3 = _mm256_set1_epi16(short(weights.fixed[3]));
+
+    int j = GAUSSIAN_RADIUS;
+
+    for (; j + 16 <= cols - GAUSSIAN_RADIUS; j += 16)
+    {
+        __m256i left3  = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(in + j - 3)));
+        __m256i left2  = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(in + j - 2)));
+        __m256i left1  = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(in + j - 1)));
+        __m256i center = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(in + j    )));
+        __m256i right1 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(in + j + 1)));
+        __m256i right2 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(in + j + 2)));
+        __m256i right3 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(in + j + 3)));
+
+        __m256i sum = _mm256_mullo_epi16(center, w0);
+
+        sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(_mm256_add_epi16(left1, right1), w1));
+        sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(_mm256_add_epi16(left2, right2), w2));
+        sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(_mm256_add_epi16(left3, right3), w3));
+
+        _mm256_storeu_si256((__m256i*)(out + j), _mm256_avg_epu16(sum, _mm256_setzero_si256()));
+    }//for
+
+    return j;
+}//gaussianHorizontalAVX2
+
+SIMD_TARGET_AVX512
+inline int gaussianHorizontalAVX512(const Gray8* in, uint16_t* out, int cols, const GaussianWeights& weights)
+{
+    const __m512i w0 = _mm512_set1_epi16(short(weights.fixed[0]));
+    const __m512i w1 = _mm512_set1_epi16(short(weights.fixed[1]));
+    const __m512i w2 = _mm512_set1_epi16(short(weights.fixed[2]));
+    const __m512i w3 = _mm512_set1_epi16(short(weights.fixed[3]));
+
+    int j = GAUSSIAN_RADIUS;
+
+    for (; j + 32 <= cols - GAUSSIAN_RADIUS; j += 32)
+    {
+        __m512i left3  = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(in + j - 3)));
+        __m512i left2  = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(in + j - 2)));
+        __m512i left1  = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(in + j - 1)));
+        __m512i center = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(in + j    )));
+        __m512i right1 = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(in + j + 1)));
+        __m512i right2 = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(in + j + 2)));
+        __m512i right3 = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(in + j + 3)));
+
+        __m512i sum = _mm512_mullo_epi16(center, w0);
+
+        sum = _mm512_add_epi16(sum, _mm512_mullo_epi16(_mm512_add_epi16(left1, right1), w1));
+        sum = _mm512_add_epi16(sum, _mm512_mullo_epi16(_mm512_add_epi16(left2, right2), w2));
+        sum = _mm512_add_epi16(sum, _mm512_mullo_epi16(_mm512_add_epi16(left3, right3), w3));
+
+        _mm512_storeu_si512((void*)(out + j), _mm512_avg_epu16(sum, _mm512_setzero_si512()));
+    }//for
+
+    return j;
+}//gaussianHorizontalAVX512
+
+//the weights are shifted up by 8 bits so that the high half of the 16x16 bit
+//product is the product rounded down to 7 fractional bits
+SIMD_TARGET_SSE41
+inline int gaussianVerticalSSE41(const uint16_t* const* rows, Gray8* out, int cols, const GaussianWeights& weights)
+{
+    const __m128i w0    = _mm_set1_epi16(short(weights.fixed[0] << 8));
+    const __m128i w1    = _mm_set1_epi16(short(weights.fixed[1] << 8));
+    const __m128i w2    = _mm_set1_epi16(short(weights.fixed[2] << 8));
+    const __m128i w3    = _mm_set1_epi16(short(weights.fixed[3] << 8));
+    const __m128i round = _mm_set1_epi16(1 << (GAUSSIAN_FRACTION_BITS - 1));
+
+    int j = 0;
+
+    for (; j + 8 <= cols; j += 8)
+    {
+        __m128i row0 = _mm_loadu_si128((const __m128i*)(rows[0] + j));
+        __m128i row1 = _mm_loadu_si128((const __m128i*)(rows[1] + j));
+        __m128i row2 = _mm_loadu_si128((const __m128i*)(rows[2] + j));
+        __m128i row3 = _mm_loadu_si128((const __m128i*)(rows[3] + j));
+        __m128i row4 = _mm_loadu_si128((const __m128i*)(rows[4] + j));
+        __m128i row5 = _mm_loadu_si128((const __m128i*)(rows[5] + j));
+        __m128i row6 = _mm_loadu_si128((const __m128i*)(rows[6] + j));
+
+        //the rows have 7 fractional bits, so a pair fits in 16 unsigned bits
+        __m128i sum = _mm_mulhi_epu16(row3, w0);
+
+        sum = _mm_add_epi16(sum, _mm_mulhi_epu16(_mm_add_epi16(row2, row4), w1));
+        sum = _mm_add_epi16(sum, _mm_mulhi_epu16(_mm_add_epi16(row1, row5), w2));
+        sum = _mm_add_epi16(sum, _mm_mulhi_epu16(_mm_add_epi16(row0, row6), w3));
+
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, round), GAUSSIAN_FRACTION_BITS);
+
+        _mm_storel_epi64((__m128i*)(out + j), _mm_packus_epi16(sum, sum));
+    }//for
+
+    return j;
+}//gaussianVerticalSSE41
+
+SIMD_TARGET_AVX2
+inline int gaussianVerticalAVX2(const uint16_t* const* rows, Gray8* out, int cols, const GaussianWeights& weights)
+{
+    const __m256i w0    = _mm256_set1_epi16(short(weights.fixed[0] << 8));
+    const __m256i w1    = _mm256_set1_epi16(short(weights.fixed[1] << 8));
+    const __m256i w2    = _mm256_set1_epi16(short(weights.fixed[2] << 8));
+    const __m256i w3    = _mm256_set1_epi16(short(weights.fixed[3] << 8));
+    const __m256i round = _mm256_set1_epi16(1 << (GAUSSIAN_FRACTION_BITS - 1));
+
+    int j = 0;
+
+    for (; j + 16 <= cols; j += 16)
+    {
+        __m256i row0 = _mm256_loadu_si256((const __m256i*)(rows[0] + j));
+        __m256i row1 = _mm256_loadu_si256((const __m256i*)(rows[1] + j));
+        __m256i row2 = _mm256_loadu_si256((const __m256i*)(rows[2] + j));
+        __m256i row3 = _mm256_loadu_si256((const __m256i*)(rows[3] + j));
+        __m256i row4 = _mm256_loadu_si256((const __m256i*)(rows[4] + j));
+        __m256i row5 = _mm256_loadu_si256((const __m256i*)(rows[5] + j));
+        __m256i row6 = _mm256_loadu_si256((const __m256i*)(rows[6] + j));
+
+        __m256i sum = _mm256_mulhi_epu16(row3, w0);
+
+        sum = _mm256_add_epi16(sum, _mm256_mulhi_epu16(_mm256_add_epi16(row2, row4), w1));
+        sum = _mm256_add_epi16(sum, _mm256_mulhi_epu16(_mm256_add_epi16(row1, row5), w2));
+        sum = _mm256_add_epi16(sum, _mm256_mulhi_epu16(_mm256_add_epi16(row0, row6), w3));
+
+        sum = _mm256_srli_epi16(_mm256_add_epi16(sum, round), GAUSSIAN_FRACTION_BITS);
+
+        //the pack works within 128 bit lanes, the permute puts both halves together
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(sum, sum), 0xD8);
+
+        _mm_storeu_si128((__m128i*)(out + j), _mm256_castsi256_si128(packed));
+    }//for
+
+    return j;
+}//gaussianVerticalAVX2
+
+SIMD_TARGET_AVX512
+inline int gaussianVerticalAVX512(const uint16_t* const* rows, Gray8* out, int cols, const GaussianWeights& weights)
+{
+    const __m512i w0    = _mm512_set1_epi16(short(weights.fixed[0] << 8));
+    const __m512i w1    = _mm512_set1_epi16(short(weights.fixed[1] << 8));
+    const __m512i w2    = _mm512_set1_epi16(short(weights.fixed[2] << 8));
+    const __m512i w3    = _mm512_set1_epi16(short(weights.fixed[3] << 8));
+    const __m512i round = _mm512_set1_epi16(1 << (GAUSSIAN_FRACTION_BITS - 1));
+
+    int j = 0;
+
+    for (; j + 32 <= cols; j += 32)
+    {
+        __m512i row0 = _mm512_loadu_si512((const void*)(rows[0] + j));
+        __m512i row1 = _mm512_loadu_si512((const void*)(rows[1] + j));
+        __m512i row2 = _mm512_loadu_si512((const void*)(rows[2] + j));
+        __m512i row3 = _mm512_loadu_si512((const void*)(rows[3] + j));
+        __m512i row4 = _mm512_loadu_si512((const void*)(rows[4] + j));
+        __m512i row5 = _mm512_loadu_si512((const void*)(rows[5] + j));
+        __m512i row6 = _mm512_loadu_si512((const void*)(rows[6] + j));
+
+        __m512i sum = _mm512_mulhi_epu16(row3, w0);
+
+        sum = _mm512_add_epi16(sum, _mm512_mulhi_epu16(_mm512_add_epi16(row2, row4), w1));
+        sum = _mm512_add_epi16(sum, _mm512_mulhi_epu16(_mm512_add_epi16(row1, row5), w2));
+        sum = _mm512_add_epi16(sum, _mm512_mulhi_epu16(_mm512_add_epi16(row0, row6), w3));
+
+        sum = _mm512_srli_epi16(_mm512_add_epi16(sum, round), GAUSSIAN_FRACTION_BITS);
+
+        //at most 255 after the shift, so truncating to 8 bits is exact. The
+        //zero-masking form, as GCC warns about the unmasked one
+        _mm256_storeu_si256((__m256i*)(out + j), _mm512_maskz_cvtepi16_epi8(__mmask32(~0u), sum));
+    }//for
+
+    return j;
+}//gaussianVerticalAVX512
+
+#endif /* SIMD_X86 */
+
+//*****************************************************************************
+//fixed point rows
+//*****************************************************************************
+
+//the horizontal pass of one row. The pixels within 3 of either end keep
+//their input value.
+inline void gaussianRowHorizontal(const Gray8* in, uint16_t* out, int cols,
+                                  const GaussianWeights& weights, SimdLevel level = simdLevel())
+{
+    int left  = std::min(GAUSSIAN_RADIUS, cols);
+    int right = std::max(cols - GAUSSIAN_RADIUS, left);
+
+    int j = 0;
+
+    for (; j < left; j++)
+    {
+        out[j] = uint16_t(in[j] << GAUSSIAN_FRACTION_BITS);
+    }//for
+
+    j = GAUSSIAN_RADIUS;
+
+#if SIMD_X86
+    switch (level)
+    {
+    case SIMD_AVX512: j = gaussianHorizontalAVX512(in, out, cols, weights); break;
+    case SIMD_AVX2:   j = gaussianHorizontalAVX2  (in, out, cols, weights); break;
+    case SIMD_SSE41:  j = gaussianHorizontalSSE41 (in, out, cols, weights); break;
+    default:          break;
+    }//switch
+#endif
+
+    gaussianColumnsHorizontal(in, out, j, cols - GAUSSIAN_RADIUS, weights);
+
+    for (j = right; j < cols; j++)
+    {
+        out[j] = uint16_t(in[j] << GAUSSIAN_FRACTION_BITS);
+    }//for
+}//gaussianRowHorizontal
+
+//rows[k] is horizontally smoothed row i - 3 + k
+inline void gaussianRowVertical(const uint16_t* const* rows, Gray8* out, int cols,
+                                const GaussianWeights& weights, SimdLevel level = simdLevel())
+{
+    int j = 0;
+
+#if SIMD_X86
+    switch (level)
+    {
+    case SIMD_AVX512: j = gaussianVerticalAVX512(rows, out, cols, weights); break;
+    case SIMD_AVX2:   j = gaussianVerticalAVX2  (rows, out, cols, weights); break;
+    case SIMD_SSE41:  j = gaussianVerticalSSE41 (rows, out, cols, weights); break;
+    default:          break;
+    }//switch
+#endif
+
+    gaussianColumnsVertical(rows, out, j, cols, weights);
+}//gaussianRowVertical
+
+//a row without the whole vertical mask keeps its horizontal result, rounded
+inline void gaussianRowFinish(const uint16_t* row, Gray8* out, int cols)
+{
+    const int ROUND = 1 << (GAUSSIAN_FRACTION_BITS - 1);
+
+    for (int j = 0; j < cols; j++)
+    {
+        out[j] = Gray8((row[j] + ROUND) >> GAUSSIAN_FRACTION_BITS);
+    }//for
+}//gaussianRowFinish
+
+//*****************************************************************************
+//whole images
+//*****************************************************************************
+
+//the rings of horizontally smoothed rows, one per thread of the pool. The
+//caller keeps them from frame to frame, so they are only allocated once.
+template <typename T>
+class GaussianRings
+{
+public:
+    typedef typename GaussianTraits<T>::Horizontal Horizontal;
+
+    GaussianRings() : rings(threadPool().size()) {}
+
+    //the ring of the calling thread, for rows of cols pixels
+    Image<Horizontal>& ring(int cols)
+    {
+        Image<Horizontal>& ring = rings[ThreadPool::threadIndex()];
+
+        ring.create(GAUSSIAN_TAPS, cols);
+
+        return ring;
+    }//ring
+
+private:
+    std::vector<Image<Horizontal> > rings;
+};//class GaussianRings
+
+//smooths the input into the output, which has to be the same size. The rows
+//are split into bands on the thread pool, and each band streams its rows
+//through the ring of the thread it runs on.
+template <typename T>
+inline void gaussianSmooth(const ImageView<const T>& input, const ImageView<T>& output,
+                           const GaussianWeights& weights, GaussianRings<T>& rings,
+                           SimdLevel level = simdLevel())
+{
+    typedef typename GaussianTraits<T>::Horizontal Horizontal;
+
+    assert(output.sameSize(input));
+
+    int rows = input.rows;
+    int cols = input.cols;
+
+    parallelForRows(0, rows, GAUSSIAN_RADIUS, [&](int begin, int end)
+    {
+        Image<Horizontal>& ring = rings.ring(cols);
+
+        int next = std::max(begin - GAUSSIAN_RADIUS, 0);
+
+        for (int i = begin; i < end; i++)
+        {
+            bool fullWindow = gaussianFullWindow(i, rows);
+
+            //the horizontal rows under the vertical mask of row i
+            for (; next < (fullWindow ? i + GAUSSIAN_RADIUS + 1 : i + 1); next++)
+            {
+                gaussianRowHorizontal(input.row(next), ring.row(next % GAUSSIAN_TAPS), cols, weights, level);
+            }//for
+
+            if (fullWindow)
+            {
+                const Horizontal* window[GAUSSIAN_TAPS];
+
+                for (int k = 0; k < GAUSSIAN_TAPS; k++)
+                {
+                    window[k] = ring.row((i - GAUSSIAN_RADIUS + k) % GAUSSIAN_TAPS);
+                }//for
+
+                gaussianRowVertical(window, output.row(i), cols, weights, level);
+            }//if
+            else
+            {
+                gaussianRowFinish(ring.row(i % GAUSSIAN_TAPS), output.row(i), cols);
+            }//else
+        }//for
+    });
+}//gaussianSmooth
+
+#endif /* GAUSSIAN_HPP_ */
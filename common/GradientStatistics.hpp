@@ -0,0 +1,192 @@
+//GradientStatistics.hpp
+//
+//The histogram of a gradient magnitude map, and the statistics the
+//parameter free edge validation reads from it.
+//
+//The number of pixels whose magnitude is at least mu, for every mu, and the
+//number of non-zero pixels are sums over the histogram, so the map is read
+//once instead of once per value of mu. The histogram can be counted by the
+//stage that writes the magnitude, a row at a time, while the row is still in
+//the cache.
+
+#ifndef GRADIENTSTATISTICS_HPP_
+#define GRADIENTSTATISTICS_HPP_
+
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#include "Image.hpp"
+#include "PixelFormats.hpp"
+#include "ThreadPool.hpp"
+
+//magnitudes 0 .. MAGNITUDE_LEVELS - 1 are counted separately, larger ones
+//share the last bin
+const int MAGNITUDE_LEVELS = 256;
+
+class MagnitudeHistogram
+{
+public:
+    static const int BINS = MAGNITUDE_LEVELS + 1;
+
+    MagnitudeHistogram()
+    {
+        clear();
+    }//MagnitudeHistogram
+
+    void clear()
+    {
+        for (int lane = 0; lane < LANES; lane++)
+        {
+            for (int k = 0; k < BINS; k++)
+            {
+                counts[lane][k] = 0;
+            }//for
+        }//for
+    }//clear
+
+    //counts one row of magnitudes. Most pixels of a magnitude map are 0, so
+    //consecutive pixels go to separate copies of the histogram, which keeps
+    //the increments of the same bin from waiting on each other.
+    void countRow(const Gray16* magnitude, int cols)
+    {
+        int j = 0;
+
+        for (; j + LANES <= cols; j += LANES)
+        {
+            for (int lane = 0; lane < LANES; lane++)
+            {
+                counts[lane][bin(magnitude[j + lane])]++;
+            }//for
+        }//for
+
+        for (; j < cols; j++)
+        {
+            counts[0][bin(magnitude[j])]++;
+        }//for
+    }//countRow
+
+    //adds the counts of another histogram, e.g. that of another thread
+    void merge(const MagnitudeHistogram& other)
+    {
+        for (int lane = 0; lane < LANES; lane++)
+        {
+            for (int k = 0; k < BINS; k++)
+            {
+                counts[lane][k] += other.counts[lane][k];
+            }//for
+        }//for
+    }//merge
+
+    //pixels in bin k
+    int64_t count(int k) const
+    {
+        int64_t sum = 0;
+
+        for (int lane = 0; lane < LANES; lane++)
+        {
+            sum += counts[lane][k];
+        }//for
+
+        return sum;
+    }//count
+
+    int64_t pixels() const
+    {
+        int64_t sum = 0;
+
+        for (int k = 0; k < BINS; k++)
+        {
+            sum += count(k);
+        }//for
+
+        return sum;
+    }//pixels
+
+    int64_t nonZero() const
+    {
+        return pixels() - count(0);
+    }//nonZero
+
+    //atLeast[mu] = number of pixels with a magnitude >= mu, for
+    //mu = 0 .. MAGNITUDE_LEVELS - 1, as a suffix sum of the histogram
+    void cumulativeCounts(int64_t (&atLeast)[MAGNITUDE_LEVELS]) const
+    {
+        int64_t sum = count(MAGNITUDE_LEVELS);
+
+        for (int mu = MAGNITUDE_LEVELS - 1; mu >= 0; mu--)
+        {
+            sum        += count(mu);
+            atLeast[mu] = sum;
+        }//for
+    }//cumulativeCounts
+
+private:
+    static const int LANES = 4;
+
+    static int bin(Gray16 magnitude)
+    {
+        return std::min(int(magnitude), MAGNITUDE_LEVELS);
+    }//bin
+
+    //a lane never sees more than the pixels of one frame, the sums of the
+    //lanes are 64 bit
+    uint32_t counts[LANES][BINS];
+};//class MagnitudeHistogram
+
+//the histograms the threads of the pool count into, one per thread. The
+//caller keeps them from frame to frame, so they are only allocated once.
+class MagnitudeHistograms
+{
+public:
+    MagnitudeHistograms() : histograms(threadPool().size()) {}
+
+    void clear()
+    {
+        for (size_t k = 0; k < histograms.size(); k++)
+        {
+            histograms[k].clear();
+        }//for
+    }//clear
+
+    //the histogram of the calling thread
+    MagnitudeHistogram& threadHistogram()
+    {
+        return histograms[ThreadPool::threadIndex()];
+    }//threadHistogram
+
+    //the counts of all of the threads
+    void merge(MagnitudeHistogram& histogram) const
+    {
+        histogram.clear();
+
+        for (size_t k = 0; k < histograms.size(); k++)
+        {
+            histogram.merge(histograms[k]);
+        }//for
+    }//merge
+
+private:
+    std::vector<MagnitudeHistogram> histograms;
+};//class MagnitudeHistograms
+
+//counts the histogram of a whole magnitude map, in bands on the thread pool.
+//Each thread counts into its own histogram, and they are merged at the end.
+inline void magnitudeHistogram(const ImageView<const Gray16>& magnitudeMap, MagnitudeHistogram& histogram,
+                               MagnitudeHistograms& threadHistograms)
+{
+    threadHistograms.clear();
+
+    parallelForRows(0, magnitudeMap.rows, 0, [&](int begin, int end)
+    {
+        MagnitudeHistogram& threadHistogram = threadHistograms.threadHistogram();
+
+        for (int i = begin; i < end; i++)
+        {
+            threadHistogram.countRow(magnitudeMap.row(i), magnitudeMap.cols);
+        }//for
+    });
+
+    threadHistograms.merge(histogram);
+}//magnitudeHistogram
+
+#endif /* GRADIENTSTATISTICS_HPP_ */
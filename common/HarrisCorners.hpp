@@ -0,0 +1,298 @@
+//HarrisCorners.hpp
+//
+//Sparse Harris corner extraction.
+//
+//Instead of a dense response image that has to be normalized and scanned
+//again, the detector keeps the response of only the last three rows. As
+//soon as the row below a row is known, that row goes through 3x3
+//non-maximum suppression, and every local maximum is offered to the cell
+//of a coarse grid that it falls in. Each cell keeps its best few corners
+//in a small bounded heap, which spreads the corners over the frame and
+//bounds their number. The result is a short list of (x, y, score).
+//
+//The rows are split into bands on the thread pool. Each band recomputes the
+//response of the rows just above and below it for the suppression, and
+//collects its local maxima, which are offered to the heaps afterwards.
+
+#ifndef HARRISCORNERS_HPP_
+#define HARRISCORNERS_HPP_
+
+#include <vector>
+#include <algorithm>
+#include "Image.hpp"
+#include "PixelFormats.hpp"
+#include "StructureTensor.hpp"
+#include "ThreadPool.hpp"
+
+struct Corner
+{
+    int   x;     //column
+    int   y;     //row
+    float score; //Harris response, det(A)/tr(A)
+};//struct Corner
+
+//the response of a pixel from the sums of its structure tensor
+inline float harrisScore(double sumXX, double sumYY, double sumXY)
+{
+    double det = sumXX*sumYY - sumXY*sumXY;
+    double tr  = sumXX + sumYY;
+
+    if (tr != 0)
+    {
+        return float(det/tr);
+    }//if
+
+    return 0;
+}//harrisScore
+
+//higher scores first, ties in scan order, so the output does not depend on
+//how the heaps happened to be arranged
+inline bool strongerCorner(const Corner& a, const Corner& b)
+{
+    if (a.score != b.score)
+    {
+        return a.score > b.score;
+    }//if
+
+    if (a.y != b.y)
+    {
+        return a.y < b.y;
+    }//if
+
+    return a.x < b.x;
+}//strongerCorner
+
+class HarrisCornerDetector
+{
+public:
+    //the frame is divided into cells of cellSize x cellSize pixels, and each
+    //cell keeps at most cornersPerCell corners. Corners weaker than
+    //minRelativeScore times the strongest response of the frame are dropped.
+    HarrisCornerDetector(int radius = 1, DerivativeKernel kernel = SCHARR_KERNEL,
+                         int cellSize = 32, int cornersPerCell = 4, float minRelativeScore = 0.01f)
+        : tensor(radius, kernel), cellSize(cellSize), cornersPerCell(cornersPerCell),
+          minRelativeScore(minRelativeScore), buffers(threadPool().size()) {}
+
+    //replaces the contents of corners with the corners of the input, strongest first
+    void detect(const ImageView<const Gray32f>& input, std::vector<Corner>& corners)
+    {
+        int rows   = input.rows;
+        int cols   = input.cols;
+        int radius = tensor.radius();
+
+        gridCols = (cols + cellSize - 1)/cellSize;
+        gridRows = (rows + cellSize - 1)/cellSize;
+
+        heaps .resize(gridCols*gridRows*cornersPerCell);
+        counts.assign(gridCols*gridRows, 0);
+
+        for (size_t k = 0; k < buffers.size(); k++)
+        {
+            buffers[k].candidates.clear();
+            buffers[k].maxScore = 0;
+        }//for
+
+        if (rows < 2*radius + 1 || cols < 2*radius + 1 || rows < 3 || cols < 3)
+        {
+            corners.clear();
+
+            return;
+        }//if
+
+        //a band needs the response of the rows above and below it, and the
+        //tensor needs radius + 1 more rows for those
+        parallelForRows(radius, rows - radius, radius + 2, [&](int begin, int end)
+        {
+            detectRows(input, begin, end);
+        });
+
+        //the heaps keep the same corners whatever order they are offered in,
+        //strongerCorner() being a total order
+        maxScore = 0;
+
+        for (size_t k = 0; k < buffers.size(); k++)
+        {
+            const std::vector<Corner>& candidates = buffers[k].candidates;
+
+            for (size_t n = 0; n < candidates.size(); n++)
+            {
+                offer(candidates[n]);
+            }//for
+
+            maxScore = std::max(maxScore, buffers[k].maxScore);
+        }//for
+
+        collect(corners);
+    }//detect
+
+private:
+    //the buffers of one thread
+    struct Buffers
+    {
+        Image<Gray32f>      responseRows; //ring of the last three rows of the response
+        std::vector<Corner> candidates;   //local maxima found by the thread
+        float               maxScore;
+    };//struct Buffers
+
+    //finds the local maxima of the rows begin .. end - 1 on the calling thread
+    void detectRows(const ImageView<const Gray32f>& input, int begin, int end)
+    {
+        int rows   = input.rows;
+        int cols   = input.cols;
+        int radius = tensor.radius();
+
+        Buffers& buffer = buffers[ThreadPool::threadIndex()];
+
+        //rows outside the window have no response, they stay 0 in the ring
+        buffer.responseRows.create(3, cols);
+        buffer.responseRows.fill(0);
+
+        int first = std::max(begin - 1, radius);
+        int last  = std::min(end + 1, rows - radius);
+
+        tensor.computeRows(input, first, last, [&](int i, const double* sumXX, const double* sumYY, const double* sumXY)
+        {
+            Gray32f* scores = buffer.responseRows.row(i % 3);
+
+            for (int j = 0; j < cols; j++)
+            {
+                scores[j] = 0;
+            }//for
+
+            for (int j = radius; j < cols - radius; j++)
+            {
+                scores[j] = harrisScore(sumXX[j], sumYY[j], sumXY[j]);
+            }//for
+
+            //the row above now has both of its neighbors
+            if (i - 1 >= begin && i - 1 < end)
+            {
+                suppressRow(buffer, i - 1, cols);
+            }//if
+        });
+
+        //the last row of the image's window has nothing below it
+        if (last == rows - radius && last - 1 >= begin)
+        {
+            Gray32f* below = buffer.responseRows.row(last % 3);
+
+            for (int j = 0; j < cols; j++)
+            {
+                below[j] = 0;
+            }//for
+
+            suppressRow(buffer, last - 1, cols);
+        }//if
+    }//detectRows
+
+    //finds the local maxima of row i, using rows i - 1 and i + 1 of the ring.
+    //A pixel has to be larger than the neighbors before it in scan order and
+    //at least as large as the ones after it, so a plateau keeps its first pixel.
+    void suppressRow(Buffers& buffer, int i, int cols)
+    {
+        const Gray32f* above = buffer.responseRows.row((i + 2) % 3);
+        const Gray32f* mid   = buffer.responseRows.row(  i      % 3);
+        const Gray32f* below = buffer.responseRows.row((i + 1) % 3);
+
+        for (int j = 1; j < cols - 1; j++)
+        {
+            float score = mid[j];
+
+            if (score > buffer.maxScore)
+            {
+                buffer.maxScore = score;
+            }//if
+
+            if (score <= 0)
+            {
+                continue;
+            }//if
+
+            if (score <= above[j - 1] || score <= above[j] || score <= above[j + 1])
+            {
+                continue;
+            }//if
+
+            if (score <= mid[j - 1] || score < mid[j + 1])
+            {
+                continue;
+            }//if
+
+            if (score < below[j - 1] || score < below[j] || score < below[j + 1])
+            {
+                continue;
+            }//if
+
+            Corner corner;
+
+            corner.x     = j;
+            corner.y     = i;
+            corner.score = score;
+
+            buffer.candidates.push_back(corner);
+        }//for
+    }//suppressRow
+
+    //keeps the corner if it is among the best cornersPerCell of its cell.
+    //Each cell is a min-heap, so the weakest kept corner is at the top.
+    void offer(const Corner& corner)
+    {
+        int     cell  = (corner.y/cellSize)*gridCols + corner.x/cellSize;
+        Corner* heap  = &heaps[cell*cornersPerCell];
+        int&    count = counts[cell];
+
+        if (count < cornersPerCell)
+        {
+            heap[count] = corner;
+            count++;
+
+            std::push_heap(heap, heap + count, strongerCorner);
+        }//if
+        else if (strongerCorner(corner, heap[0]))
+        {
+            std::pop_heap(heap, heap + count, strongerCorner);
+
+            heap[count - 1] = corner;
+
+            std::push_heap(heap, heap + count, strongerCorner);
+        }//else if
+    }//offer
+
+    void collect(std::vector<Corner>& corners)
+    {
+        corners.clear();
+
+        float minScore = minRelativeScore*maxScore;
+
+        for (int cell = 0; cell < gridCols*gridRows; cell++)
+        {
+            const Corner* heap = &heaps[cell*cornersPerCell];
+
+            for (int k = 0; k < counts[cell]; k++)
+            {
+                if (heap[k].score >= minScore)
+                {
+                    corners.push_back(heap[k]);
+                }//if
+            }//for
+        }//for
+
+        std::sort(corners.begin(), corners.end(), strongerCorner);
+    }//collect
+
+    StructureTensor tensor;
+
+    int   cellSize;
+    int   cornersPerCell;
+    float minRelativeScore;
+
+    int   gridCols;
+    int   gridRows;
+    float maxScore;
+
+    std::vector<Corner>  heaps;   //cornersPerCell entries per cell
+    std::vector<int>     counts;  //corners kept in each cell
+    std::vector<Buffers> buffers; //one per thread of the pool
+};//class HarrisCornerDetector
+
+#endif /* HARRISCORNERS_HPP_ */
@@ -0,0 +1,272 @@
+//Image.hpp
+//
+//Contiguous, row-strided image storage shared by all of the programs.
+//
+//An Image<T> owns a single aligned allocation holding every row of the frame.
+//Each row is padded so that it starts on a cache line boundary, which keeps
+//row pointers aligned for vector loads. An ImageView<T> is a non-owning
+//window into an image (or into any other buffer with a row stride, such as
+//a cv::Mat), and can be narrowed to a region of interest without copying.
+//
+//Pixels are addressed as (i, j) = (row, column), the same way the
+//vector< vector<...> > frames were indexed before.
+
+#ifndef IMAGE_HPP_
+#define IMAGE_HPP_
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+//every row of an Image starts on a boundary of this many bytes
+const size_t IMAGE_ALIGNMENT = 64;
+
+//*****************************************************************************
+//aligned allocation helpers
+//*****************************************************************************
+
+//the pointer returned by malloc is stored just before the aligned block so
+//that it can be handed back to free
+inline void* alignedMalloc(size_t size)
+{
+    unsigned char* raw = (unsigned char*) malloc(size + IMAGE_ALIGNMENT + sizeof(void*));
+
+    if (raw == NULL)
+    {
+        throw std::bad_alloc();
+    }//if
+
+    size_t address = (size_t)(raw + sizeof(void*));
+    address        = (address + IMAGE_ALIGNMENT - 1) & ~(IMAGE_ALIGNMENT - 1);
+
+    ((void**) address)[-1] = raw;
+
+    return (void*) address;
+}//alignedMalloc
+
+inline void alignedFree(void* block)
+{
+    if (block != NULL)
+    {
+        free(((void**) block)[-1]);
+    }//if
+}//alignedFree
+
+//rounds a row length in bytes up to the next multiple of IMAGE_ALIGNMENT
+inline size_t alignedStep(size_t rowBytes)
+{
+    return (rowBytes + IMAGE_ALIGNMENT - 1) & ~(IMAGE_ALIGNMENT - 1);
+}//alignedStep
+
+//*****************************************************************************
+//ImageView
+//*****************************************************************************
+
+template <typename T>
+struct ImageView
+{
+    T*     data; //first pixel of the first row
+    int    rows;
+    int    cols;
+    size_t step; //distance in bytes between the starts of two rows
+
+    ImageView() : data(NULL), rows(0), cols(0), step(0) {}
+
+    ImageView(T* data, int rows, int cols, size_t step)
+        : data(data), rows(rows), cols(cols), step(step) {}
+
+    //lets a view of T be passed where a view of const T is expected. Only
+    //pointer-compatible pixel types convert, so overloads on different pixel
+    //formats stay unambiguous.
+    template <typename U>
+    ImageView(const ImageView<U>& other,
+              typename std::enable_if<std::is_convertible<U*, T*>::value>::type* = NULL)
+        : data(other.data), rows(other.rows), cols(other.cols), step(other.step) {}
+
+    T* row(int i) const
+    {
+        return (T*)((unsigned char*) data + step*i);
+    }//row
+
+    T& operator()(int i, int j) const
+    {
+        return row(i)[j];
+    }//operator()
+
+    //a window of roiRows x roiCols pixels whose top left corner is at (i, j)
+    ImageView<T> roi(int i, int j, int roiRows, int roiCols) const
+    {
+        return ImageView<T>(row(i) + j, roiRows, roiCols, step);
+    }//roi
+
+    bool empty() const
+    {
+        return data == NULL || rows == 0 || cols == 0;
+    }//empty
+
+    template <typename U>
+    bool sameSize(const ImageView<U>& other) const
+    {
+        return rows == other.rows && cols == other.cols;
+    }//sameSize
+};//struct ImageView
+
+//sets the outermost 'border' rows and columns of the view to value.
+//stages that only compute the interior use this to define their borders
+//when an output image is reused from frame to frame.
+template <typename T>
+void fillBorder(const ImageView<T>& image, int border, const T& value)
+{
+    for (int i = 0; i < image.rows; i++)
+    {
+        T* out = image.row(i);
+
+        if (i < border || i >= image.rows - border)
+        {
+            for (int j = 0; j < image.cols; j++)
+            {
+                out[j] = value;
+            }//for
+        }//if
+        else
+        {
+            for (int j = 0; j < border && j < image.cols; j++)
+            {
+                out[j]                  = value;
+                out[image.cols - 1 - j] = value;
+            }//for
+        }//else
+    }//for
+}//fillBorder
+
+//*****************************************************************************
+//Image
+//*****************************************************************************
+
+//T is expected to be a plain pixel struct or arithmetic type, pixels are
+//copied with memcpy and new storage is zero filled.
+template <typename T>
+class Image : public ImageView<T>
+{
+public:
+    Image() : buffer(NULL), capacity(0) {}
+
+    Image(int rows, int cols) : buffer(NULL), capacity(0)
+    {
+        create(rows, cols);
+    }//Image
+
+    Image(const Image& other) : ImageView<T>(), buffer(NULL), capacity(0)
+    {
+        copyFrom(other);
+    }//Image
+
+    Image(Image&& other) : ImageView<T>(other), buffer(other.buffer), capacity(other.capacity)
+    {
+        other.data     = NULL;
+        other.rows     = 0;
+        other.cols     = 0;
+        other.step     = 0;
+        other.buffer   = NULL;
+        other.capacity = 0;
+    }//Image
+
+    ~Image()
+    {
+        alignedFree(buffer);
+    }//~Image
+
+    Image& operator=(const Image& other)
+    {
+        if (this != &other)
+        {
+            copyFrom(other);
+        }//if
+
+        return *this;
+    }//operator=
+
+    Image& operator=(Image&& other)
+    {
+        if (this != &other)
+        {
+            alignedFree(buffer);
+
+            this -> data     = other.data;
+            this -> rows     = other.rows;
+            this -> cols     = other.cols;
+            this -> step     = other.step;
+            buffer           = other.buffer;
+            capacity         = other.capacity;
+
+            other.data     = NULL;
+            other.rows     = 0;
+            other.cols     = 0;
+            other.step     = 0;
+            other.buffer   = NULL;
+            other.capacity = 0;
+        }//if
+
+        return *this;
+    }//operator=
+
+    //sizes the image to rows x cols. The storage is only reallocated when it
+    //is too small, so an image that is re-created with the same size every
+    //frame never touches the heap after the first frame. Freshly allocated
+    //storage is zero filled; reused storage keeps its old contents.
+    void create(int rows, int cols)
+    {
+        size_t rowStep = alignedStep(sizeof(T)*cols);
+        size_t size    = rowStep*rows;
+
+        if (size > capacity)
+        {
+            alignedFree(buffer);
+
+            buffer   = NULL;
+            capacity = 0;
+
+            buffer   = alignedMalloc(size);
+            capacity = size;
+
+            memset(buffer, 0, size);
+        }//if
+
+        this -> data = (T*) buffer;
+        this -> rows = rows;
+        this -> cols = cols;
+        this -> step = rowStep;
+    }//create
+
+    void fill(const T& value)
+    {
+        for (int i = 0; i < this -> rows; i++)
+        {
+            T* out = this -> row(i);
+
+            for (int j = 0; j < this -> cols; j++)
+            {
+                out[j] = value;
+            }//for
+        }//for
+    }//fill
+
+    //resizes this image to match the source and copies every row
+    void copyFrom(const ImageView<const T>& source)
+    {
+        create(source.rows, source.cols);
+
+        for (int i = 0; i < source.rows; i++)
+        {
+            memcpy(this -> row(i), source.row(i), sizeof(T)*source.cols);
+        }//for
+    }//copyFrom
+
+private:
+    void*  buffer;
+    size_t capacity; //bytes available in buffer
+};//class Image
+
+#endif /* IMAGE_HPP_ */
@@ -0,0 +1,35 @@
+//MatView.hpp
+//
+//Zero-copy ImageViews of cv::Mat buffers.
+//
+//A view wraps the Mat's own data pointer and row step, so a stage can read
+//a captured frame and write the frame that is shown without first copying
+//it into (or out of) an Image.
+
+#ifndef MATVIEW_HPP_
+#define MATVIEW_HPP_
+
+#include <opencv2/core/core.hpp>
+#include "Image.hpp"
+
+//the Mat keeps ownership of its pixels, so the view is only valid until the
+//Mat is reallocated or released (e.g. by reading the next frame into it).
+//T has to match the Mat's element size, e.g. BGR8 for CV_8UC3 or Gray32f
+//for CV_32FC1; use matView<const T> for read-only access.
+template <typename T>
+inline ImageView<T> matView(cv::Mat& mat)
+{
+    CV_Assert(mat.elemSize() == sizeof(T));
+
+    return ImageView<T>((T*) mat.data, mat.rows, mat.cols, mat.step[0]);
+}//matView
+
+template <typename T>
+inline ImageView<const T> matView(const cv::Mat& mat)
+{
+    CV_Assert(mat.elemSize() == sizeof(T));
+
+    return ImageView<const T>((const T*) mat.data, mat.rows, mat.cols, mat.step[0]);
+}//matView
+
+#endif /* MATVIEW_HPP_ */
@@ -0,0 +1,87 @@
+//PackedDirections.hpp
+//
+//A map of small per-pixel codes, such as a quantized gradient direction,
+//packed BITS to a pixel.
+//
+//A direction only takes a few values, so storing it in a byte (or a float)
+//per pixel moves several times more memory than it carries. Here each row
+//is packed LSB first, 8/BITS pixels to a byte, into an Image<uint8_t>, so
+//the rows keep the alignment and the stride of an image and can be written
+//by separate bands in parallel. BITS is 1, 2, 4 or 8. With BITS = 1 the map
+//is a bitmap, e.g. of the pixels a stage has visited.
+
+#ifndef PACKEDDIRECTIONS_HPP_
+#define PACKEDDIRECTIONS_HPP_
+
+#include <stdint.h>
+#include <cstring>
+#include "Image.hpp"
+
+template <int BITS>
+class PackedDirections
+{
+public:
+    static_assert(BITS == 1 || BITS == 2 || BITS == 4 || BITS == 8, "BITS has to divide a byte");
+
+    static const int      PIXELS_PER_BYTE = 8/BITS;
+    static const unsigned MASK            = (1u << BITS) - 1;
+
+    int rows;
+    int cols;
+
+    PackedDirections() : rows(0), cols(0) {}
+
+    //like Image::create(), the storage is kept when the size does not grow
+    void create(int rows, int cols)
+    {
+        this -> rows = rows;
+        this -> cols = cols;
+
+        bytes.create(rows, packedCols(cols));
+    }//create
+
+    //sets every code to 0
+    void clear()
+    {
+        for (int i = 0; i < rows; i++)
+        {
+            memset(row(i), 0, packedCols(cols));
+        }//for
+    }//clear
+
+    //the packed bytes of row i
+    uint8_t* row(int i) const
+    {
+        return bytes.row(i);
+    }//row
+
+    unsigned operator()(int i, int j) const
+    {
+        return get(row(i), j);
+    }//operator()
+
+    void set(int i, int j, unsigned code)
+    {
+        uint8_t& packed = row(i)[j/PIXELS_PER_BYTE];
+        int      shift  = (j % PIXELS_PER_BYTE)*BITS;
+
+        packed = uint8_t((packed & ~(MASK << shift)) | (code << shift));
+    }//set
+
+    //the code of pixel j of a packed row
+    static unsigned get(const uint8_t* packed, int j)
+    {
+        return (packed[j/PIXELS_PER_BYTE] >> ((j % PIXELS_PER_BYTE)*BITS)) & MASK;
+    }//get
+
+    //bytes needed for a row of cols pixels
+    static int packedCols(int cols)
+    {
+        return (cols + PIXELS_PER_BYTE - 1)/PIXELS_PER_BYTE;
+    }//packedCols
+
+private:
+    Image<uint8_t> bytes;
+};//class PackedDirections
+
+#endif /* PACKEDDIRECTIONS_HPP_ */
@@ -0,0 +1,186 @@
+//PixelFormats.hpp
+//
+//Compile-time pixel formats for Image<T>.
+//
+//Capture and display buffers are 8 bit BGR, and everything after grayScale()
+//only needs one channel, so the stages are templated on these types instead
+//of carrying a BGR triple of floats through the whole pipeline.
+
+#ifndef PIXELFORMATS_HPP_
+#define PIXELFORMATS_HPP_
+
+#include <stdint.h>
+
+//single channel formats
+typedef uint8_t Gray8;   //8 bit intensity, 0..255
+typedef uint16_t Gray16; //unsigned 16 bit, e.g. gradient magnitudes of 8 bit images
+typedef int16_t Gray16s; //signed 16 bit, for derivatives of 8 bit images
+typedef float   Gray32f; //floating point intensity
+
+//three channel formats, in the channel order of an OpenCV frame
+struct BGR8
+{
+    uint8_t B;
+    uint8_t G;
+    uint8_t R;
+};//struct BGR8
+
+struct BGR32f
+{
+    float B;
+    float G;
+    float R;
+};//struct BGR32f
+
+//*****************************************************************************
+//format traits
+//*****************************************************************************
+
+//Channel is the type of one channel. Single channel formats also have a Sum
+//type, which is wide enough to accumulate a small kernel (e.g. a 3x3 Sobel)
+//over the format's range without overflowing.
+template <typename T>
+struct PixelTraits;
+
+template <>
+struct PixelTraits<Gray8>
+{
+    typedef uint8_t Channel;
+    typedef int     Sum;
+    static const int CHANNELS = 1;
+};//struct PixelTraits<Gray8>
+
+template <>
+struct PixelTraits<Gray16>
+{
+    typedef uint16_t Channel;
+    typedef int      Sum;
+    static const int CHANNELS = 1;
+};//struct PixelTraits<Gray16>
+
+template <>
+struct PixelTraits<Gray16s>
+{
+    typedef int16_t Channel;
+    typedef int     Sum;
+    static const int CHANNELS = 1;
+};//struct PixelTraits<Gray16s>
+
+template <>
+struct PixelTraits<Gray32f>
+{
+    typedef float   Channel;
+    typedef float   Sum;
+    static const int CHANNELS = 1;
+};//struct PixelTraits<Gray32f>
+
+template <>
+struct PixelTraits<BGR8>
+{
+    typedef uint8_t Channel;
+    static const int CHANNELS = 3;
+};//struct PixelTraits<BGR8>
+
+template <>
+struct PixelTraits<BGR32f>
+{
+    typedef float   Channel;
+    static const int CHANNELS = 3;
+};//struct PixelTraits<BGR32f>
+
+//*****************************************************************************
+//conversions
+//*****************************************************************************
+
+//converts the result of a stage's arithmetic into a single channel format.
+//integer formats are rounded to the nearest value and clamped to their
+//range (NaN becomes 0), floating point values are passed through unchanged.
+template <typename T>
+inline T saturateCast(double value);
+
+template <>
+inline Gray8 saturateCast<Gray8>(double value)
+{
+    if (!(value > 0))
+    {
+        return 0;
+    }//if
+
+    if (value >= 255)
+    {
+        return 255;
+    }//if
+
+    return Gray8(value + 0.5);
+}//saturateCast<Gray8>
+
+template <>
+inline Gray16 saturateCast<Gray16>(double value)
+{
+    if (!(value > 0))
+    {
+        return 0;
+    }//if
+
+    if (value >= 65535)
+    {
+        return 65535;
+    }//if
+
+    return Gray16(value + 0.5);
+}//saturateCast<Gray16>
+
+template <>
+inline Gray16s saturateCast<Gray16s>(double value)
+{
+    if (value != value)
+    {
+        return 0;
+    }//if
+
+    if (value <= -32768)
+    {
+        return -32768;
+    }//if
+
+    if (value >= 32767)
+    {
+        return 32767;
+    }//if
+
+    return Gray16s(value >= 0 ? value + 0.5 : value - 0.5);
+}//saturateCast<Gray16s>
+
+template <>
+inline Gray32f saturateCast<Gray32f>(double value)
+{
+    return Gray32f(value);
+}//saturateCast<Gray32f>
+
+//a single channel value written to a three channel format becomes a gray
+//pixel, which lets a stage write its result straight into a display frame
+template <>
+inline BGR8 saturateCast<BGR8>(double value)
+{
+    BGR8 pixel;
+
+    pixel.B = saturateCast<Gray8>(value);
+    pixel.G = pixel.B;
+    pixel.R = pixel.B;
+
+    return pixel;
+}//saturateCast<BGR8>
+
+template <>
+inline BGR32f saturateCast<BGR32f>(double value)
+{
+    BGR32f pixel;
+
+    pixel.B = Gray32f(value);
+    pixel.G = pixel.B;
+    pixel.R = pixel.B;
+
+    return pixel;
+}//saturateCast<BGR32f>
+
+#endif /* PIXELFORMATS_HPP_ */
@@ -0,0 +1,79 @@
+//Simd.hpp
+//
+//Runtime selection of the vector instruction set used by the kernels.
+//
+//The programs are built for the baseline x86-64 instruction set, and each
+//vectorized kernel is compiled for its own instruction set with a GCC target
+//attribute. The best level the CPU supports is read from cpuid once, the
+//first time simdLevel() is called, and every kernel dispatches on it. On
+//other compilers and architectures only the scalar kernels are built.
+
+#ifndef SIMD_HPP_
+#define SIMD_HPP_
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#include <immintrin.h>
+#else
+#define SIMD_X86 0
+#endif
+
+#if SIMD_X86
+#define SIMD_TARGET_SSE41  __attribute__((target("sse4.1")))
+#define SIMD_TARGET_AVX2   __attribute__((target("avx2")))
+#define SIMD_TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#endif
+
+//ordered from slowest to fastest, so levels can be compared with < and >
+enum SimdLevel
+{
+    SIMD_SCALAR,
+    SIMD_SSE41,  //4 floats or 8 16 bit integers per instruction
+    SIMD_AVX2,   //8 floats or 16 16 bit integers per instruction
+    SIMD_AVX512  //16 floats or 32 16 bit integers per instruction (F and BW)
+};
+
+inline SimdLevel detectSimdLevel()
+{
+#if SIMD_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+    {
+        return SIMD_AVX512;
+    }//if
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return SIMD_AVX2;
+    }//if
+
+    if (__builtin_cpu_supports("sse4.1"))
+    {
+        return SIMD_SSE41;
+    }//if
+#endif
+
+    return SIMD_SCALAR;
+}//detectSimdLevel
+
+//the level the kernels use by default, detected once per process
+inline SimdLevel simdLevel()
+{
+    static const SimdLevel level = detectSimdLevel();
+
+    return level;
+}//simdLevel
+
+inline const char* simdLevelName(SimdLevel level)
+{
+    switch (level)
+    {
+    case SIMD_SSE41:  return "sse4.1";
+    case SIMD_AVX2:   return "avx2";
+    case SIMD_AVX512: return "avx512";
+    default:          return "scalar";
+    }//switch
+}//simdLevelName
+
+#endif /* SIMD_HPP_ */
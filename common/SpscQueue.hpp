@@ -0,0 +1,89 @@
+//SpscQueue.hpp
+//
+//A bounded lock-free queue from one producer thread to one consumer thread.
+//
+//The queue is a ring of capacity + 1 slots. Only the producer writes the
+//tail and only the consumer writes the head, each with a release store that
+//the other side reads with an acquire load, so a push or a pop is a few loads
+//and one store, with no lock and no read-modify-write. The two indices are
+//kept on separate cache lines, so that the threads do not pass one line back
+//and forth on every operation.
+//
+//Neither side ever waits inside the queue: push() fails when it is full and
+//pop() when it is empty, and the caller decides whether to wait, retry or
+//drop.
+
+#ifndef SPSCQUEUE_HPP_
+#define SPSCQUEUE_HPP_
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+template <typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(int capacity) : slots(capacity + 1), head(0), tail(0) {}
+
+    int capacity() const
+    {
+        return int(slots.size()) - 1;
+    }//capacity
+
+    //producer only, false if the queue is full
+    bool push(const T& value)
+    {
+        size_t last = tail.load(std::memory_order_relaxed);
+        size_t next = advance(last);
+
+        if (next == head.load(std::memory_order_acquire))
+        {
+            return false;
+        }//if
+
+        slots[last] = value;
+
+        tail.store(next, std::memory_order_release);
+
+        return true;
+    }//push
+
+    //consumer only, false if the queue is empty
+    bool pop(T& value)
+    {
+        size_t first = head.load(std::memory_order_relaxed);
+
+        if (first == tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }//if
+
+        value = slots[first];
+
+        head.store(advance(first), std::memory_order_release);
+
+        return true;
+    }//pop
+
+private:
+    SpscQueue(const SpscQueue&);
+    SpscQueue& operator=(const SpscQueue&);
+
+    static const size_t CACHE_LINE = 64;
+
+    size_t advance(size_t index) const
+    {
+        return index + 1 == slots.size() ? 0 : index + 1;
+    }//advance
+
+    std::vector<T> slots;
+
+    char                padding0[CACHE_LINE];
+    std::atomic<size_t> head; //next slot to pop, written by the consumer
+    char                padding1[CACHE_LINE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail; //next slot to push, written by the producer
+    char                padding2[CACHE_LINE - sizeof(std::atomic<size_t>)];
+};//class SpscQueue
+
+#endif /* SPSCQUEUE_HPP_ */
@@ -0,0 +1,499 @@
+//StageTiming.hpp
+//
+//Latency histograms of the stages of a program, for finding where the time
+//of a frame goes and for setting targets on it.
+//
+//The timing is only compiled in when STAGE_TIMING is defined to 1 (e.g.
+//with -DSTAGE_TIMING=1). Otherwise STAGE_TIMER and STAGE_RECORD expand to
+//nothing and StageLaps is an empty class, so a build without it has no
+//trace of the timers.
+//
+//    STAGE_TIMER("sort");              //times the rest of the scope
+//    STAGE_RECORD("latency", nanos);   //records a time measured elsewhere
+//
+//Every thread records into histograms of its own, so recording takes no
+//lock and shares no cache line: a clock read at each end and a few
+//instructions to find the bucket. A histogram has 16 linear buckets per
+//power of two of nanoseconds (the HDR histogram layout), so a percentile is
+//within 1/16 of the true value over the whole range of an int64, in a
+//fixed 8KB.
+//
+//A stage that is split into bands which run on the thread pool, like the
+//fused anchor pipeline, adds up the time of its bands with StageLaps, and
+//records the sum, the CPU time of the stage, once per frame.
+//
+//The summary of every stage, with the count, mean, p50, p99, p99.9 and the
+//largest time, merged over the threads, is printed to stderr when the
+//program exits, when it gets SIGUSR1, and every STAGE_TIMING_PERIOD seconds
+//if that is defined. The signal and the period are looked at by
+//stageTimingPoll(), which the video pipeline calls once per frame shown.
+
+#ifndef STAGETIMING_HPP_
+#define STAGETIMING_HPP_
+
+#ifndef STAGE_TIMING
+#define STAGE_TIMING 0
+#endif
+
+#include <stdint.h>
+
+#if STAGE_TIMING
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+//nanoseconds on a steady clock
+inline int64_t stageNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}//stageNow
+
+//counts of nanosecond values in log-linear buckets. Only one thread
+//records, any thread can read while it does.
+class LatencyHistogram
+{
+public:
+    static const int SUB_BITS = 4;
+    static const int SUB      = 1 << SUB_BITS; //linear buckets per power of two
+    static const int BUCKETS  = (64 - SUB_BITS + 1)*SUB;
+
+    LatencyHistogram() : count(0), sum(0), largest(0)
+    {
+        for (int k = 0; k < BUCKETS; k++)
+        {
+            counts[k].store(0, std::memory_order_relaxed);
+        }//for
+    }//LatencyHistogram
+
+    //single writer, so a load and a store do for an increment
+    void record(int64_t nanos)
+    {
+        uint64_t value = nanos > 0 ? uint64_t(nanos) : 0;
+
+        bump(counts[bucket(value)], 1);
+        bump(count, 1);
+        bump(sum, value);
+
+        if (value > largest.load(std::memory_order_relaxed))
+        {
+            largest.store(value, std::memory_order_relaxed);
+        }//if
+    }//record
+
+    //adds the counts of another histogram into a private copy
+    void merge(const LatencyHistogram& other)
+    {
+        for (int k = 0; k < BUCKETS; k++)
+        {
+            bump(counts[k], other.counts[k].load(std::memory_order_relaxed));
+        }//for
+
+        bump(count, other.count.load(std::memory_order_relaxed));
+        bump(sum,   other.sum  .load(std::memory_order_relaxed));
+
+        if (other.largest.load(std::memory_order_relaxed) > largest.load(std::memory_order_relaxed))
+        {
+            largest.store(other.largest.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }//if
+    }//merge
+
+    uint64_t samples() const
+    {
+        return count.load(std::memory_order_relaxed);
+    }//samples
+
+    double mean() const
+    {
+        uint64_t n = samples();
+
+        return n > 0 ? double(sum.load(std::memory_order_relaxed))/n : 0;
+    }//mean
+
+    uint64_t maximum() const
+    {
+        return largest.load(std::memory_order_relaxed);
+    }//maximum
+
+    //the largest value of the bucket that holds the q-th quantile, 0..1
+    uint64_t percentile(double q) const
+    {
+        uint64_t n    = samples();
+        uint64_t rank = uint64_t(q*n + 0.5);
+        uint64_t seen = 0;
+
+        rank = rank < 1 ? 1 : rank > n ? n : rank;
+
+        for (int k = 0; k < BUCKETS && n > 0; k++)
+        {
+            seen += counts[k].load(std::memory_order_relaxed);
+
+            if (seen >= rank)
+            {
+                uint64_t top = bucketTop(k);
+
+                return top < maximum() ? top : maximum();
+            }//if
+        }//for
+
+        return 0;
+    }//percentile
+
+private:
+    LatencyHistogram(const LatencyHistogram&);
+    LatencyHistogram& operator=(const LatencyHistogram&);
+
+    static void bump(std::atomic<uint64_t>& counter, uint64_t amount)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }//bump
+
+    //values below SUB have a bucket each, above that a power of two 2^e is
+    //split into SUB buckets by the SUB_BITS bits under its leading one
+    static int bucket(uint64_t value)
+    {
+        if (value < uint64_t(SUB))
+        {
+            return int(value);
+        }//if
+
+        int exponent = 63 - leadingZeros(value);
+        int sub      = int(value >> (exponent - SUB_BITS)) & (SUB - 1);
+
+        return (exponent - SUB_BITS + 1)*SUB + sub;
+    }//bucket
+
+    static uint64_t bucketTop(int k)
+    {
+        if (k < SUB)
+        {
+            return uint64_t(k);
+        }//if
+
+        int exponent = k/SUB + SUB_BITS - 1;
+        int sub      = k % SUB;
+
+        return ((uint64_t(SUB + sub + 1)) << (exponent - SUB_BITS)) - 1;
+    }//bucketTop
+
+    static int leadingZeros(uint64_t value)
+    {
+#if defined(__GNUC__)
+        return __builtin_clzll(value);
+#else
+        int zeros = 0;
+
+        for (uint64_t bit = uint64_t(1) << 63; (value & bit) == 0; bit >>= 1)
+        {
+            zeros++;
+        }//for
+
+        return zeros;
+#endif
+    }//leadingZeros
+
+    std::atomic<uint64_t> counts[BUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> largest;
+};//class LatencyHistogram
+
+//the stages and the histograms of every thread. The histograms of a thread
+//are made the first time it records a stage and kept until the program
+//ends, so that the summary at exit has the threads that have finished.
+class StageTimes
+{
+public:
+    static const int MAX_STAGES = 64;
+
+    static StageTimes& instance()
+    {
+        static StageTimes* times = new StageTimes();
+
+        return *times;
+    }//instance
+
+    //the index of a stage, called once per place that records it
+    int stageIndex(const char* name)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (int k = 0; k < stageCount.load(std::memory_order_relaxed); k++)
+        {
+            if (strcmp(names[k], name) == 0)
+            {
+                return k;
+            }//if
+        }//for
+
+        int k = stageCount.load(std::memory_order_relaxed);
+
+        if (k == MAX_STAGES)
+        {
+            return MAX_STAGES - 1;
+        }//if
+
+        names[k] = name;
+
+        stageCount.store(k + 1, std::memory_order_release);
+
+        return k;
+    }//stageIndex
+
+    void record(int stage, int64_t nanos)
+    {
+        static thread_local ThreadHistograms* histograms = NULL;
+
+        if (histograms == NULL)
+        {
+            histograms = addThread();
+        }//if
+
+        LatencyHistogram* histogram = histograms -> stages[stage].load(std::memory_order_relaxed);
+
+        if (histogram == NULL)
+        {
+            histogram = new LatencyHistogram();
+
+            histograms -> stages[stage].store(histogram, std::memory_order_release);
+        }//if
+
+        histogram -> record(nanos);
+    }//record
+
+    void print(FILE* stream)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        int stages = stageCount.load(std::memory_order_acquire);
+
+        fprintf(stream, "%-14s %10s %10s %10s %10s %10s %10s  (ms)\n",
+                "stage", "count", "mean", "p50", "p99", "p99.9", "max");
+
+        for (int k = 0; k < stages; k++)
+        {
+            LatencyHistogram merged;
+
+            for (size_t t = 0; t < threads.size(); t++)
+            {
+                const LatencyHistogram* histogram = threads[t] -> stages[k].load(std::memory_order_acquire);
+
+                if (histogram != NULL)
+                {
+                    merged.merge(*histogram);
+                }//if
+            }//for
+
+            fprintf(stream, "%-14s %10llu %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+                    names[k], (unsigned long long) merged.samples(), merged.mean()*1e-6,
+                    merged.percentile(0.5)*1e-6, merged.percentile(0.99)*1e-6,
+                    merged.percentile(0.999)*1e-6, merged.maximum()*1e-6);
+        }//for
+
+        fflush(stream);
+    }//print
+
+    //true once after SIGUSR1, or when the period has passed
+    bool summaryDue()
+    {
+        if (signalled().exchange(false))
+        {
+            return true;
+        }//if
+
+#ifdef STAGE_TIMING_PERIOD
+        int64_t now = stageNow();
+
+        if (now - lastSummary >= int64_t(STAGE_TIMING_PERIOD*1e9))
+        {
+            lastSummary = now;
+
+            return true;
+        }//if
+#endif
+
+        return false;
+    }//summaryDue
+
+private:
+    struct ThreadHistograms
+    {
+        std::atomic<LatencyHistogram*> stages[MAX_STAGES];
+
+        ThreadHistograms()
+        {
+            for (int k = 0; k < MAX_STAGES; k++)
+            {
+                stages[k].store(NULL, std::memory_order_relaxed);
+            }//for
+        }//ThreadHistograms
+    };//struct ThreadHistograms
+
+    StageTimes() : stageCount(0), lastSummary(stageNow())
+    {
+        atexit(printAtExit);
+
+#ifdef SIGUSR1
+        signal(SIGUSR1, onSignal);
+#endif
+    }//StageTimes
+
+    ThreadHistograms* addThread()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        threads.push_back(new ThreadHistograms());
+
+        return threads.back();
+    }//addThread
+
+    static std::atomic<bool>& signalled()
+    {
+        static std::atomic<bool> flag(false);
+
+        return flag;
+    }//signalled
+
+    static void onSignal(int)
+    {
+        signalled().store(true);
+    }//onSignal
+
+    static void printAtExit()
+    {
+        instance().print(stderr);
+    }//printAtExit
+
+    std::mutex                      mutex;
+    const char*                     names[MAX_STAGES];
+    std::atomic<int>                stageCount;
+    std::vector<ThreadHistograms*>  threads;
+    int64_t                         lastSummary; //only read by the thread that polls
+};//class StageTimes
+
+inline void printStageTimes(FILE* stream)
+{
+    StageTimes::instance().print(stream);
+}//printStageTimes
+
+//prints the summary if it was asked for by a signal or the period is over,
+//called regularly from one thread
+inline void stageTimingPoll()
+{
+    if (StageTimes::instance().summaryDue())
+    {
+        printStageTimes(stderr);
+    }//if
+}//stageTimingPoll
+
+//records the time from its construction to the end of its scope
+class ScopedStageTimer
+{
+public:
+    explicit ScopedStageTimer(int stage) : stage(stage), start(stageNow()) {}
+
+    ~ScopedStageTimer()
+    {
+        StageTimes::instance().record(stage, stageNow() - start);
+    }//~ScopedStageTimer
+
+private:
+    int     stage;
+    int64_t start;
+};//class ScopedStageTimer
+
+//the time of a loop, split between STAGES parts: lap(k) adds the time since
+//the last lap (or start) to part k
+template <int STAGES>
+class StageLaps
+{
+public:
+    StageLaps()
+    {
+        clear();
+    }//StageLaps
+
+    void clear()
+    {
+        for (int k = 0; k < STAGES; k++)
+        {
+            nanos[k] = 0;
+        }//for
+    }//clear
+
+    void start()
+    {
+        last = stageNow();
+    }//start
+
+    void lap(int k)
+    {
+        int64_t now = stageNow();
+
+        nanos[k] += now - last;
+        last      = now;
+    }//lap
+
+    void add(const StageLaps& other)
+    {
+        for (int k = 0; k < STAGES; k++)
+        {
+            nanos[k] += other.nanos[k];
+        }//for
+    }//add
+
+    int64_t nanoseconds(int k) const
+    {
+        return nanos[k];
+    }//nanoseconds
+
+private:
+    int64_t nanos[STAGES];
+    int64_t last;
+};//class StageLaps
+
+#define STAGE_TIMING_CONCAT_(a, b) a##b
+#define STAGE_TIMING_CONCAT(a, b)  STAGE_TIMING_CONCAT_(a, b)
+
+#define STAGE_TIMER(name) \
+    static const int STAGE_TIMING_CONCAT(stageIndex_, __LINE__) = StageTimes::instance().stageIndex(name); \
+    ScopedStageTimer STAGE_TIMING_CONCAT(stageTimer_, __LINE__)(STAGE_TIMING_CONCAT(stageIndex_, __LINE__))
+
+#define STAGE_RECORD(name, nanos) \
+    do \
+    { \
+        static const int stageIndex_ = StageTimes::instance().stageIndex(name); \
+        StageTimes::instance().record(stageIndex_, (nanos)); \
+    } while (0)
+
+#else
+
+inline void stageTimingPoll() {}
+
+//compiles to nothing without STAGE_TIMING
+template <int STAGES>
+class StageLaps
+{
+public:
+    void clear() {}
+    void start() {}
+    void lap(int) {}
+    void add(const StageLaps&) {}
+
+    int64_t nanoseconds(int) const
+    {
+        return 0;
+    }//nanoseconds
+};//class StageLaps
+
+#define STAGE_TIMER(name)
+#define STAGE_RECORD(name, nanos) do {} while (0)
+
+#endif /* STAGE_TIMING */
+
+#endif /* STAGETIMING_HPP_ */
@@ -0,0 +1,204 @@
+//StructureTensor.hpp
+//
+//Windowed structure tensor [Sxx, Sxy; Sxy, Syy] of an image, computed with
+//running sums so that the cost per pixel does not depend on the window size.
+//
+//The image is streamed one row at a time: the derivatives of a row are
+//computed into a line buffer, the three products Gx*Gx, Gy*Gy and Gx*Gy are
+//computed once per pixel in float and kept in a ring of 2*radius + 1 line
+//buffers, and a running sum per column adds the newest row of products and
+//subtracts the one that falls out of the window. Each output row is then a
+//running sum along the column sums. No full-frame temporaries are used and
+//the buffers are reused from frame to frame.
+//
+//The running sums are kept in double precision so that adding and removing
+//rows does not accumulate rounding error down the frame.
+//
+//The rows are split into bands that run on the thread pool. Each band
+//starts its running sums from the window of its first row, with its own
+//line buffers, so the result depends on the band boundaries, which are
+//fixed, and not on the number of threads.
+
+#ifndef STRUCTURETENSOR_HPP_
+#define STRUCTURETENSOR_HPP_
+
+#include <vector>
+#include "Image.hpp"
+#include "PixelFormats.hpp"
+#include "Derivatives.hpp"
+#include "ThreadPool.hpp"
+
+class StructureTensor
+{
+public:
+    //the window is (2*radius + 1) x (2*radius + 1) pixels
+    StructureTensor(int radius = 1, DerivativeKernel kernel = SOBEL_KERNEL)
+        : windowRadius(radius), derivativeKernel(kernel), buffers(threadPool().size()) {}
+
+    int radius() const
+    {
+        return windowRadius;
+    }//radius
+
+    //calls rowFunction(i, sxx, syy, sxy) for every row i whose window lies
+    //inside the image. The three arrays hold the window sums of row i and are
+    //valid for the columns whose window lies inside the image, radius .. cols
+    //- 1 - radius. The derivatives are 0 on the outermost rows and columns of
+    //the image.
+    //The bands run in parallel, so rowFunction is called from several threads
+    //at once, but for each row only once, and within a band from top to bottom.
+    template <typename RowFunction>
+    void compute(const ImageView<const Gray32f>& input, RowFunction rowFunction)
+    {
+        int rows   = input.rows;
+        int cols   = input.cols;
+        int window = 2*windowRadius + 1;
+
+        if (rows < window || cols < window || rows < 3 || cols < 3)
+        {
+            return;
+        }//if
+
+        //the window of a band's first row reaches radius rows above it, and
+        //the derivatives one more
+        parallelForRows(windowRadius, rows - windowRadius, windowRadius + 1, [&](int begin, int end)
+        {
+            computeRows(input, begin, end, rowFunction);
+        });
+    }//compute
+
+    //the same for the rows begin .. end - 1 only, which have to lie in
+    //radius .. rows - 1 - radius, on the calling thread. Stages that run
+    //their own bands on the thread pool call this from each band.
+    template <typename RowFunction>
+    void computeRows(const ImageView<const Gray32f>& input, int begin, int end, RowFunction rowFunction)
+    {
+        int rows   = input.rows;
+        int cols   = input.cols;
+        int window = 2*windowRadius + 1;
+
+        if (rows < window || cols < window || rows < 3 || cols < 3 || end <= begin)
+        {
+            return;
+        }//if
+
+        Buffers& buffer = buffers[ThreadPool::threadIndex()];
+
+        buffer.gx.create(1, cols);
+        buffer.gy.create(1, cols);
+        buffer.products  .create(3*window, cols);
+        buffer.columnSums.create(3, cols);
+        buffer.windowSums.create(3, cols);
+
+        buffer.columnSums.fill(0);
+
+        Gray32f* g_x = buffer.gx.row(0);
+        Gray32f* g_y = buffer.gy.row(0);
+
+        double* columnXX = buffer.columnSums.row(0);
+        double* columnYY = buffer.columnSums.row(1);
+        double* columnXY = buffer.columnSums.row(2);
+
+        //the input rows under the windows of rows begin .. end - 1
+        int first = begin - windowRadius;
+        int last  = end   + windowRadius;
+
+        for (int i = first; i < last; i++)
+        {
+            //the products of row i replace those of row i - window in the ring
+            int slot = (i - first) % window;
+
+            Gray32f* xx = buffer.products.row(3*slot    );
+            Gray32f* yy = buffer.products.row(3*slot + 1);
+            Gray32f* xy = buffer.products.row(3*slot + 2);
+
+            if (i - first >= window)
+            {
+                for (int j = 0; j < cols; j++)
+                {
+                    columnXX[j] -= xx[j];
+                    columnYY[j] -= yy[j];
+                    columnXY[j] -= xy[j];
+                }//for
+            }//if
+
+            if (i == 0 || i == rows - 1)
+            {
+                for (int j = 0; j < cols; j++)
+                {
+                    g_x[j] = 0;
+                    g_y[j] = 0;
+                }//for
+            }//if
+            else
+            {
+                derivativeRow(input.row(i - 1), input.row(i), input.row(i + 1), g_x, g_y, cols, derivativeKernel);
+            }//else
+
+            for (int j = 0; j < cols; j++)
+            {
+                xx[j] = g_x[j]*g_x[j];
+                yy[j] = g_y[j]*g_y[j];
+                xy[j] = g_x[j]*g_y[j];
+
+                columnXX[j] += xx[j];
+                columnYY[j] += yy[j];
+                columnXY[j] += xy[j];
+            }//for
+
+            //the column sums now cover rows i - window + 1 .. i
+            if (i - first >= window - 1)
+            {
+                int center = i - windowRadius;
+
+                slideRow(columnXX, buffer.windowSums.row(0), cols);
+                slideRow(columnYY, buffer.windowSums.row(1), cols);
+                slideRow(columnXY, buffer.windowSums.row(2), cols);
+
+                rowFunction(center, (const double*) buffer.windowSums.row(0),
+                                    (const double*) buffer.windowSums.row(1),
+                                    (const double*) buffer.windowSums.row(2));
+            }//if
+        }//for
+    }//computeRows
+
+private:
+    //sums each window of 2*radius + 1 column sums along the row
+    void slideRow(const double* columns, double* sums, int cols) const
+    {
+        int window = 2*windowRadius + 1;
+
+        double sum = 0;
+
+        for (int j = 0; j < window; j++)
+        {
+            sum += columns[j];
+        }//for
+
+        sums[windowRadius] = sum;
+
+        for (int j = windowRadius + 1; j < cols - windowRadius; j++)
+        {
+            sum += columns[j + windowRadius] - columns[j - windowRadius - 1];
+
+            sums[j] = sum;
+        }//for
+    }//slideRow
+
+    //the line buffers of one thread
+    struct Buffers
+    {
+        Image<Gray32f> gx;         //derivatives of the newest row
+        Image<Gray32f> gy;
+        Image<Gray32f> products;   //ring of xx, yy, xy rows, three rows per slot
+        Image<double>  columnSums; //xx, yy, xy summed down the window
+        Image<double>  windowSums; //xx, yy, xy summed over the whole window
+    };//struct Buffers
+
+    int              windowRadius;
+    DerivativeKernel derivativeKernel;
+
+    std::vector<Buffers> buffers; //one per thread of the pool
+};//class StructureTensor
+
+#endif /* STRUCTURETENSOR_HPP_ */
@@ -0,0 +1,27 @@
+//SurfaceView.hpp
+//
+//Zero-copy ImageViews of SDL_Surface pixels.
+//
+//The view wraps the surface's pixels and pitch, so an image can be written
+//straight into the screen surface instead of going through putpixel() with
+//a y*pitch + x*bpp address calculation for every pixel.
+
+#ifndef SURFACEVIEW_HPP_
+#define SURFACEVIEW_HPP_
+
+#include <cassert>
+#include "SDL.h"
+#include "Image.hpp"
+
+//the surface has to stay locked while the view is in use if
+//SDL_MUSTLOCK(surface) is true. T has to match the surface's bytes per
+//pixel, e.g. Uint8 for an 8 bit palettized surface or Uint32 for 32 bits.
+template <typename T>
+inline ImageView<T> surfaceView(SDL_Surface* surface)
+{
+    assert(surface -> format -> BytesPerPixel == sizeof(T));
+
+    return ImageView<T>((T*) surface -> pixels, surface -> h, surface -> w, surface -> pitch);
+}//surfaceView
+
+#endif /* SURFACEVIEW_HPP_ */
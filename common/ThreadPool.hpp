@@ -0,0 +1,246 @@
+//ThreadPool.hpp
+//
+//A persistent pool of worker threads, and parallelForRows(), which splits a
+//range of rows into horizontal bands and runs the bands on the pool.
+//
+//The workers are started once, the first time threadPool() is called, and
+//sleep between calls, so a stage only pays for waking them up. The calling
+//thread works on the bands too, and the bands are handed out one at a time,
+//so a thread that finishes early takes the next one.
+//
+//The band boundaries only depend on the row range and the halo, never on the
+//number of threads. A stage whose result depends on where its band starts
+//(e.g. one that streams a window down the band and has to run through the
+//halo rows first) therefore gives the same result on one thread as on many.
+
+#ifndef THREADPOOL_HPP_
+#define THREADPOOL_HPP_
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+class ThreadPool
+{
+public:
+    //threads counts the calling thread, so threads - 1 workers are started
+    explicit ThreadPool(int threads) : taskFunction(NULL), taskContext(NULL), taskCount(0),
+                                       busy(0), generation(0), stopping(false)
+    {
+        for (int k = 1; k < threads; k++)
+        {
+            workers.push_back(std::thread(&ThreadPool::work, this, k));
+        }//for
+    }//ThreadPool
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            stopping = true;
+        }
+
+        wake.notify_all();
+
+        for (size_t k = 0; k < workers.size(); k++)
+        {
+            workers[k].join();
+        }//for
+    }//~ThreadPool
+
+    //number of threads that run tasks, including the calling thread
+    int size() const
+    {
+        return int(workers.size()) + 1;
+    }//size
+
+    //index of the calling thread, 0 .. size() - 1. Threads outside the pool
+    //are 0, so per thread buffers can be indexed with it.
+    static int threadIndex()
+    {
+        return currentThread();
+    }//threadIndex
+
+    //calls task(k) for k = 0 .. count - 1 and returns once all of them are
+    //done. A task that calls run() again gets its tasks run serially on its
+    //own thread.
+    template <typename Task>
+    void run(int count, Task task)
+    {
+        if (workers.empty() || count <= 1 || insideTask())
+        {
+            for (int k = 0; k < count; k++)
+            {
+                task(k);
+            }//for
+
+            return;
+        }//if
+
+        //one job at a time, the workers share the task state
+        std::lock_guard<std::mutex> runLock(runMutex);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            taskFunction = &invoke<Task>;
+            taskContext  = &task;
+            taskCount    = count;
+            busy         = int(workers.size());
+
+            nextTask.store(0);
+
+            generation++;
+        }
+
+        wake.notify_all();
+
+        runTasks();
+
+        std::unique_lock<std::mutex> lock(mutex);
+
+        done.wait(lock, [this]() { return busy == 0; });
+    }//run
+
+private:
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    template <typename Task>
+    static void invoke(void* context, int k)
+    {
+        (*static_cast<Task*>(context))(k);
+    }//invoke
+
+    static int& currentThread()
+    {
+        static thread_local int index = 0;
+
+        return index;
+    }//currentThread
+
+    static bool& insideTask()
+    {
+        static thread_local bool inside = false;
+
+        return inside;
+    }//insideTask
+
+    void runTasks()
+    {
+        insideTask() = true;
+
+        for (int k = nextTask.fetch_add(1); k < taskCount; k = nextTask.fetch_add(1))
+        {
+            taskFunction(taskContext, k);
+        }//for
+
+        insideTask() = false;
+    }//runTasks
+
+    void work(int index)
+    {
+        currentThread() = index;
+
+        unsigned seen = 0;
+
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                wake.wait(lock, [&]() { return stopping || generation != seen; });
+
+                if (stopping)
+                {
+                    return;
+                }//if
+
+                seen = generation;
+            }
+
+            runTasks();
+
+            std::lock_guard<std::mutex> lock(mutex);
+
+            busy--;
+
+            if (busy == 0)
+            {
+                done.notify_one();
+            }//if
+        }//while
+    }//work
+
+    std::vector<std::thread> workers;
+
+    std::mutex              runMutex;
+    std::mutex              mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    //the current job
+    void            (*taskFunction)(void*, int);
+    void*             taskContext;
+    int               taskCount;
+    std::atomic<int>  nextTask;
+
+    int      busy;       //workers that have not finished the current job
+    unsigned generation; //counts the jobs, so the workers see a new one
+    bool     stopping;
+};//class ThreadPool
+
+//one thread per core
+inline int defaultThreadCount()
+{
+    int threads = int(std::thread::hardware_concurrency());
+
+    return threads > 0 ? threads : 1;
+}//defaultThreadCount
+
+//the pool the stages run on, started once per process
+inline ThreadPool& threadPool()
+{
+    static ThreadPool pool(defaultThreadCount());
+
+    return pool;
+}//threadPool
+
+//a band is at least ROW_BAND_ROWS rows high, and at least 8 times the halo,
+//so that the halo rows a streaming stage recomputes cost at most a quarter
+//of the band
+const int ROW_BAND_ROWS = 16;
+
+inline int rowBandHeight(int halo)
+{
+    return std::max(ROW_BAND_ROWS, 8*halo);
+}//rowBandHeight
+
+//calls rowFunction(bandBegin, bandEnd) for bands of rows that together cover
+//begin .. end - 1, in parallel on the pool. halo is how many rows above and
+//below its band the function reads (or has to recompute). Every band only
+//writes its own rows of the output, so the bands never race.
+template <typename RowFunction>
+inline void parallelForRows(int begin, int end, int halo, RowFunction rowFunction, ThreadPool& pool = threadPool())
+{
+    if (end <= begin)
+    {
+        return;
+    }//if
+
+    int height = rowBandHeight(halo);
+    int bands  = (end - begin + height - 1)/height;
+
+    pool.run(bands, [&](int band)
+    {
+        int first = begin + band*height;
+
+        rowFunction(first, std::min(first + height, end));
+    });
+}//parallelForRows
+
+#endif /* THREADPOOL_HPP_ */
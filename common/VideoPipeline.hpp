@@ -0,0 +1,327 @@
+//VideoPipeline.hpp
+//
+//Runs a video through decoding, processing and display on separate threads.
+//
+//One thread decodes the frames, a number of workers each process every n-th
+//frame on threads of their own, and the calling thread shows the frames in
+//order. Decoding, processing and showing consecutive frames overlap, so the
+//time per frame is that of the slowest stage instead of the sum of all of
+//them, and the wait for a key press only holds up the display.
+//
+//The frames are allocated once, when the pipeline is made, and recycled: the
+//threads hand pointers to them on through SpscQueues, and the display gives
+//back every frame it has shown to the decoding thread. The Mats of a frame
+//keep their storage, so once the first frames have been decoded nothing is
+//allocated per frame.
+//
+//The queue in front of each worker is bounded. When the next worker's queue
+//is full, or all of the frames are in use, the decoding thread either waits
+//(WAIT_WHEN_FULL, every frame is shown, e.g. for a file) or drops frames
+//(DROP_WHEN_FULL, the frames shown stay close to live, e.g. for a camera).
+
+#ifndef VIDEOPIPELINE_HPP_
+#define VIDEOPIPELINE_HPP_
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include "SpscQueue.hpp"
+#include "StageTiming.hpp"
+
+enum FullQueuePolicy
+{
+    WAIT_WHEN_FULL, //back pressure, decoding waits for the workers
+    DROP_WHEN_FULL  //frames that find no room are dropped
+};//enum FullQueuePolicy
+
+struct VideoFrame
+{
+    cv::Mat     input;   //as decoded, read only for the worker
+    cv::Mat     output;  //written by the worker, the size and type of the input
+    std::string results; //written by the worker, a line per result
+    int         number;  //position in the video, counting the dropped frames
+#if STAGE_TIMING
+    int64_t     captured; //stageNow() when decoding started, for the latency
+#endif
+
+    VideoFrame() : number(0) {}
+};//struct VideoFrame
+
+//Worker is called as worker(const cv::Mat& input, cv::Mat& output,
+//std::string& results), on its own thread, with the results emptied. Every
+//worker keeps its own buffers, the stages it runs can share the thread pool.
+template <typename Worker>
+class VideoPipeline
+{
+public:
+    //workers[k] processes frames k, k + workers.size(), ... and can have
+    //depth frames queued ahead of the one it is processing
+    VideoPipeline(std::vector<Worker>& workers, int depth, FullQueuePolicy policy)
+        : workers(workers), depth(std::max(depth, 1)), policy(policy),
+          frames(workers.size()*(depth + 2) + 2), dropCount(0), stopping(false) {}
+
+    //decodes and processes the video until it ends or show(frame) returns
+    //false. show is called on the calling thread, for the frames in order.
+    template <typename Show>
+    void run(cv::VideoCapture& video, Show show)
+    {
+        int count = int(workers.size());
+
+        //a NULL frame ends the stream of a queue
+        freeFrames.reset(new SpscQueue<VideoFrame*>(int(frames.size())));
+        toWorkers  .clear();
+        fromWorkers.clear();
+
+        for (int k = 0; k < count; k++)
+        {
+            toWorkers  .push_back(QueuePointer(new SpscQueue<VideoFrame*>(depth)));
+            fromWorkers.push_back(QueuePointer(new SpscQueue<VideoFrame*>(int(frames.size()) + 1)));
+        }//for
+
+        for (size_t k = 0; k < frames.size(); k++)
+        {
+            freeFrames -> push(&frames[k]);
+        }//for
+
+        dropCount.store(0);
+        stopping .store(false);
+
+        std::thread              decoder(&VideoPipeline::decode, this, std::ref(video));
+        std::vector<std::thread> processors;
+
+        for (int k = 0; k < count; k++)
+        {
+            processors.push_back(std::thread(&VideoPipeline::process, this, k));
+        }//for
+
+        //frame n comes from worker n % count. Once a worker's stream has
+        //ended, the streams of the others end too, and they are emptied.
+        bool showing = true;
+        int  next    = 0;
+
+        while (true)
+        {
+            VideoFrame* frame = waitToPop(*fromWorkers[next]);
+
+            if (frame == NULL)
+            {
+                break;
+            }//if
+
+            if (showing)
+            {
+                STAGE_TIMER("output");
+
+                if (!show(static_cast<const VideoFrame&>(*frame)))
+                {
+                    showing = false;
+
+                    stopping.store(true);
+                }//if
+            }//if
+
+            STAGE_RECORD("latency", stageNow() - frame -> captured);
+
+            stageTimingPoll();
+
+            freeFrames -> push(frame);
+
+            next = (next + 1) % count;
+        }//while
+
+        for (int k = 1; k < count; k++)
+        {
+            SpscQueue<VideoFrame*>& queue = *fromWorkers[(next + k) % count];
+
+            for (VideoFrame* frame = waitToPop(queue); frame != NULL; frame = waitToPop(queue))
+            {
+                freeFrames -> push(frame);
+            }//for
+        }//for
+
+        decoder.join();
+
+        for (int k = 0; k < count; k++)
+        {
+            processors[k].join();
+        }//for
+    }//run
+
+    //frames dropped by the last run(), with DROP_WHEN_FULL
+    int droppedFrames() const
+    {
+        return dropCount.load();
+    }//droppedFrames
+
+private:
+    typedef std::unique_ptr<SpscQueue<VideoFrame*> > QueuePointer;
+
+    //a thread that waits spins a little for a queue that is about to change,
+    //and then sleeps, so that it does not take a core from the stage it
+    //waits for
+    static void backOff(int& spins)
+    {
+        const int SPINS = 64;
+
+        if (spins < SPINS)
+        {
+            spins++;
+
+            std::this_thread::yield();
+        }//if
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }//else
+    }//backOff
+
+    static VideoFrame* waitToPop(SpscQueue<VideoFrame*>& queue)
+    {
+        VideoFrame* frame;
+
+        for (int spins = 0; !queue.pop(frame); )
+        {
+            backOff(spins);
+        }//for
+
+        return frame;
+    }//waitToPop
+
+    static void waitToPush(SpscQueue<VideoFrame*>& queue, VideoFrame* frame)
+    {
+        for (int spins = 0; !queue.push(frame); )
+        {
+            backOff(spins);
+        }//for
+    }//waitToPush
+
+    static void readFrame(cv::VideoCapture& video, cv::Mat& input)
+    {
+        STAGE_TIMER("capture");
+
+        video >> input;
+    }//readFrame
+
+    void decode(cv::VideoCapture& video)
+    {
+        int         count = int(workers.size());
+        int         next  = 0;    //worker of the next frame
+        VideoFrame* frame = NULL; //the frame being decoded into
+        int         read  = 0;    //frames read from the video
+
+        for (int spins = 0; !stopping.load(); )
+        {
+            if (frame == NULL && !freeFrames -> pop(frame))
+            {
+                //every frame is queued or shown
+                if (policy == WAIT_WHEN_FULL)
+                {
+                    backOff(spins);
+
+                    continue;
+                }//if
+
+                if (!video.grab())
+                {
+                    break;
+                }//if
+
+                read++;
+                dropCount++;
+
+                continue;
+            }//if
+
+#if STAGE_TIMING
+            frame -> captured = stageNow();
+#endif
+
+            readFrame(video, frame -> input);
+
+            if (frame -> input.empty())
+            {
+                break;
+            }//if
+
+            frame -> number = read++;
+
+            bool handedOn = toWorkers[next] -> push(frame);
+
+            while (!handedOn && policy == WAIT_WHEN_FULL && !stopping.load())
+            {
+                backOff(spins);
+
+                handedOn = toWorkers[next] -> push(frame);
+            }//while
+
+            if (!handedOn)
+            {
+                //the frame is decoded into again
+                if (policy == DROP_WHEN_FULL)
+                {
+                    dropCount++;
+                }//if
+
+                continue;
+            }//if
+
+            frame = NULL;
+            next  = (next + 1) % count;
+            spins = 0;
+        }//for
+
+        for (int k = 0; k < count; k++)
+        {
+            waitToPush(*toWorkers[k], NULL);
+        }//for
+    }//decode
+
+    void process(int k)
+    {
+        while (true)
+        {
+            VideoFrame* frame = waitToPop(*toWorkers[k]);
+
+            if (frame == NULL)
+            {
+                break;
+            }//if
+
+            //frames still queued once the display has stopped are passed on
+            //without being processed
+            if (!stopping.load())
+            {
+                STAGE_TIMER("process");
+
+                frame -> output.create(frame -> input.size(), frame -> input.type());
+                frame -> results.clear();
+
+                workers[k](static_cast<const cv::Mat&>(frame -> input), frame -> output, frame -> results);
+            }//if
+
+            fromWorkers[k] -> push(frame);
+        }//while
+
+        fromWorkers[k] -> push(NULL);
+    }//process
+
+    std::vector<Worker>&    workers;
+    int                     depth;
+    FullQueuePolicy         policy;
+    std::vector<VideoFrame> frames;
+
+    QueuePointer              freeFrames;  //display to decoding
+    std::vector<QueuePointer> toWorkers;   //decoding to each worker
+    std::vector<QueuePointer> fromWorkers; //each worker to display
+
+    std::atomic<int>  dropCount;
+    std::atomic<bool> stopping; //set when show() returns false
+};//class VideoPipeline
+
+#endif /* VIDEOPIPELINE_HPP_ */